@@ -0,0 +1,331 @@
+#include "analysis.h"
+#include "headless.h"
+#include "movie.h"
+
+#include <stdio.h>
+#include <cstdlib>
+#include <cstring>
+
+#define OP_PHA 0x48
+//a table longer than this is more likely a run of data that happens to hold rom addresses
+#define TABLE_MAX_ENTRIES 128
+
+struct codeWalk {
+	const cartridge* cart;
+	romAnalysis* result;
+	uint32_t* pending;//cpu addresses still to decode
+	uint32_t pendingCount;
+	uint32_t pendingSize;
+	bool ok;
+};
+
+bool romOffset(const cartridge& cart, uint16_t address, uint32_t& offset) {
+	if (address < DECODE_BASE)
+		return false;
+	offset = (address - DECODE_BASE) & (cart.prgSize - 1);
+	return true;
+}
+
+uint16_t romWord(const cartridge& cart, uint32_t offset) {
+	return cart.prg[offset & (cart.prgSize - 1)] | (cart.prg[(offset + 1) & (cart.prgSize - 1)] << 8);
+}
+
+bool isIndexedLoad(uint8_t opcode) {
+	//LDA abs,x  LDA abs,y  LDY abs,x  LDX abs,y
+	return opcode == 0xBD || opcode == 0xB9 || opcode == 0xBC || opcode == 0xBE;
+}
+
+//queues a jump target and marks it as starting a block, code outside rom is left alone
+void addTarget(codeWalk& walk, uint16_t address, uint8_t flags) {
+	uint32_t offset;
+	if (!romOffset(*walk.cart, address, offset))
+		return;
+	walk.result->flags[offset] |= CODE_BLOCK | flags;
+	if (walk.result->flags[offset] & CODE_OPCODE)
+		return;
+	if (walk.pendingCount == walk.pendingSize) {
+		uint32_t size = walk.pendingSize ? walk.pendingSize * 2 : 64;
+		uint32_t* grown = (uint32_t*)realloc(walk.pending, size * sizeof(uint32_t));
+		if (!grown) {
+			walk.ok = false;
+			return;
+		}
+		walk.pending = grown;
+		walk.pendingSize = size;
+	}
+	walk.pending[walk.pendingCount++] = address;
+}
+
+//the code that dispatched through a pointer or an rts loaded the two halves of the address with
+//indexed reads, the table is taken to run from those reads until an entry stops looking like one
+void addJumpTable(codeWalk& walk, uint32_t low, uint32_t high, uint8_t kind) {
+	romAnalysis& result = *walk.result;
+	const cartridge& cart = *walk.cart;
+	uint32_t stride = high == low + 1 ? 2 : 1;
+	jumpTable table = { (uint16_t)low, (uint16_t)high, 0, kind };
+	for (uint32_t i = 0; i < TABLE_MAX_ENTRIES; i++) {
+		uint32_t lo = low + i * stride, hi = high + i * stride;
+		if (lo >= cart.prgSize || hi >= cart.prgSize || (stride == 1 && (lo == high || hi == low))
+			|| ((result.flags[lo] | result.flags[hi]) & (CODE_OPCODE | CODE_OPERAND | CODE_BLOCK)))
+			break;
+		//a run of one byte value is fill, $EAEA and $FFFF both look like rom addresses
+		uint32_t after = (lo > hi ? lo : hi) + 1;
+		if (cart.prg[lo] == cart.prg[hi] && after < cart.prgSize && cart.prg[after] == cart.prg[lo])
+			break;
+		uint16_t target = (uint16_t)((cart.prg[lo] | (cart.prg[hi] << 8)) + (kind == TABLE_RTS ? 1 : 0));
+		uint32_t targetOffset;
+		//entries have to land on an opcode, not inside a known instruction or on an unmapped opcode
+		if (!romOffset(cart, target, targetOffset) || opInfo(cart.prg[targetOffset]).name[0] == '?'
+			|| (result.flags[targetOffset] & (CODE_OPERAND | CODE_OPCODE)) == CODE_OPERAND)
+			break;
+		result.flags[lo] |= CODE_JUMPTABLE;
+		result.flags[hi] |= CODE_JUMPTABLE;
+		addTarget(walk, target, 0);
+		table.entries++;
+	}
+	if (!table.entries)
+		return;
+	jumpTable* grown = (jumpTable*)realloc(result.tables, (result.tableCount + 1) * sizeof(jumpTable));
+	if (!grown) {
+		walk.ok = false;
+		return;
+	}
+	result.tables = grown;
+	result.tables[result.tableCount++] = table;
+}
+
+//decodes straight line code until control leaves it or it runs into code already decoded
+void decodeRun(codeWalk& walk, uint16_t address) {
+	const cartridge& cart = *walk.cart;
+	uint8_t* flags = walk.result->flags;
+	uint32_t loads[2];
+	uint8_t loadCount = 0, pushes = 0;
+	uint32_t offset;
+	while (walk.ok && romOffset(cart, address, offset) && !(flags[offset] & CODE_OPCODE)) {
+		uint8_t opcode = cart.prg[offset];
+		const cpuOpInfo& info = opInfo(opcode);
+		//the jams and unstable opcodes are left unmapped, running into one means this was data
+		if (info.name[0] == '?')
+			return;
+		uint8_t length = opLength(info.mode);
+		uint16_t operand = romWord(cart, offset + 1);
+		flags[offset] |= CODE_OPCODE;
+		for (uint8_t i = 1; i < length; i++) {
+			flags[(offset + i) & (cart.prgSize - 1)] |= CODE_OPERAND;
+		}
+		uint16_t next = address + length;
+		uint32_t pointer;
+		if (info.mode == AM_REL) {
+			addTarget(walk, next + (int8_t)operand, 0);
+			addTarget(walk, next, 0);
+			return;
+		}
+		switch (opcode) {
+		case OP_JSR:
+			addTarget(walk, operand, 0);
+			addTarget(walk, next, 0);
+			return;
+		case OP_JMP:
+			addTarget(walk, operand, 0);
+			return;
+		case OP_JMPI:
+			if (romOffset(cart, operand, pointer)) {
+				//the pointer's high byte comes from the same page, as on the cpu
+				uint32_t highByte = (pointer & ~0xFFU) | ((pointer + 1) & 0xFF);
+				addTarget(walk, cart.prg[pointer] | (cart.prg[highByte] << 8), 0);
+			}
+			else if (loadCount == 2)
+				addJumpTable(walk, loads[0], loads[1], TABLE_JMP);
+			return;
+		case OP_RTS:
+			//the high byte is pushed first so it is the first of the two loads
+			if (loadCount == 2 && pushes >= 2)
+				addJumpTable(walk, loads[1], loads[0], TABLE_RTS);
+			return;
+		case OP_RTI:
+		case OP_BRK:
+			return;
+		case OP_PHA:
+			pushes++;
+			break;
+		}
+		if (isIndexedLoad(opcode) && romOffset(cart, operand, pointer)) {
+			if (loadCount == 2) {
+				loads[0] = loads[1];
+				loadCount = 1;
+			}
+			loads[loadCount++] = pointer;
+		}
+		address = next;
+	}
+}
+
+//splits the decoded instructions into blocks, each ends at a change of flow or the next jump target
+bool findBlocks(const cartridge& cart, romAnalysis& result) {
+	uint32_t size = 0;
+	uint32_t offset = 0;
+	while (offset < cart.prgSize) {
+		if (!(result.flags[offset] & CODE_OPCODE)) {
+			offset++;
+			continue;
+		}
+		if (result.blockCount == size) {
+			size = size ? size * 2 : 64;
+			romBlock* grown = (romBlock*)realloc(result.blocks, size * sizeof(romBlock));
+			if (!grown)
+				return false;
+			result.blocks = grown;
+		}
+		romBlock& block = result.blocks[result.blockCount++];
+		block = { (uint16_t)offset, 0, 0 };
+		result.flags[offset] |= CODE_BLOCK;
+		while (true) {
+			uint8_t opcode = cart.prg[offset];
+			block.bytes += opLength(opInfo(opcode).mode);
+			block.instructions++;
+			offset += opLength(opInfo(opcode).mode);
+			if (endsBlock(opcode) || offset >= cart.prgSize || block.instructions == BLOCK_MAX_INSTRUCTIONS
+				|| (result.flags[offset] & (CODE_OPCODE | CODE_BLOCK)) != CODE_OPCODE)
+				break;
+		}
+	}
+	return true;
+}
+
+bool analyzeROM(const cartridge& cart, romAnalysis& result) {
+	memset(&result, 0, sizeof(result));
+	if (cart.prgSize != 0x4000 && cart.prgSize != 0x8000) {
+		printf("prg of %u bytes is not fixed at $8000, only nrom can be analysed\n", cart.prgSize);
+		return false;
+	}
+	result.prgSize = cart.prgSize;
+	result.prgHash = hashBytes(cart.prg, cart.prgSize, 0);
+	result.flags = (uint8_t*)calloc(cart.prgSize, 1);
+	codeWalk walk = { &cart, &result, nullptr, 0, 0, result.flags != nullptr };
+	static const uint16_t vectors[] = { RST_VEC, NMI_VEC, IRQ_VEC };
+	for (uint16_t vector : vectors) {
+		uint32_t offset;
+		if (walk.ok && romOffset(cart, vector, offset))
+			addTarget(walk, romWord(cart, offset), CODE_ENTRY);
+	}
+	while (walk.ok && walk.pendingCount) {
+		decodeRun(walk, (uint16_t)walk.pending[--walk.pendingCount]);
+	}
+	free(walk.pending);
+	if (!walk.ok || !findBlocks(cart, result)) {
+		destroyAnalysis(result);
+		return false;
+	}
+	return true;
+}
+
+void writeLE16(FILE* f, uint16_t value) {
+	uint8_t bytes[2] = { (uint8_t)value, (uint8_t)(value >> 8) };
+	fwrite(bytes, 1, 2, f);
+}
+
+void writeLE32(FILE* f, uint32_t value) {
+	writeLE16(f, (uint16_t)value);
+	writeLE16(f, (uint16_t)(value >> 16));
+}
+
+uint16_t readLE16(const uint8_t* p) {
+	return p[0] | (p[1] << 8);
+}
+
+bool saveAnalysis(const romAnalysis& result, const char* path) {
+	FILE* f = fopen(path, "wb");
+	if (!f) {
+		printf("could not create %s\n", path);
+		return false;
+	}
+	uint32_t runs = 0;
+	for (uint32_t i = 0; i < result.prgSize; runs++) {
+		uint32_t start = i;
+		while (i < result.prgSize && i - start < 0xFFFF && result.flags[i] == result.flags[start]) i++;
+	}
+	fwrite("NRA1", 1, 4, f);
+	writeLE32(f, result.prgSize);
+	writeLE32(f, (uint32_t)result.prgHash);
+	writeLE32(f, (uint32_t)(result.prgHash >> 32));
+	writeLE32(f, runs);
+	writeLE32(f, result.blockCount);
+	writeLE32(f, result.tableCount);
+	for (uint32_t i = 0; i < result.prgSize;) {
+		uint32_t start = i;
+		while (i < result.prgSize && i - start < 0xFFFF && result.flags[i] == result.flags[start]) i++;
+		fputc(result.flags[start], f);
+		writeLE16(f, (uint16_t)(i - start));
+	}
+	for (uint32_t i = 0; i < result.blockCount; i++) {
+		writeLE16(f, result.blocks[i].offset);
+		writeLE16(f, result.blocks[i].bytes);
+		fputc(result.blocks[i].instructions, f);
+	}
+	for (uint32_t i = 0; i < result.tableCount; i++) {
+		writeLE16(f, result.tables[i].low);
+		writeLE16(f, result.tables[i].high);
+		fputc(result.tables[i].entries, f);
+		fputc(result.tables[i].kind, f);
+	}
+	bool ok = !ferror(f);
+	fclose(f);
+	return ok;
+}
+
+bool loadAnalysis(const cartridge& cart, const char* path, romAnalysis& result) {
+	memset(&result, 0, sizeof(result));
+	size_t size;
+	void* mapping;
+	const uint8_t* data = (const uint8_t*)mapFile(path, size, mapping);
+	if (!data)
+		return false;
+	bool ok = size >= ANALYSIS_HEADER && memcmp(data, "NRA1", 4) == 0;
+	uint32_t runs = ok ? readLE32(data + 0x10) : 0;
+	result.blockCount = ok ? readLE32(data + 0x14) : 0;
+	result.tableCount = ok ? readLE32(data + 0x18) : 0;
+	ok = ok && size == ANALYSIS_HEADER + (uint64_t)runs * 3 + (uint64_t)result.blockCount * 5 + (uint64_t)result.tableCount * 6;
+	if (!ok)
+		printf("%s is not an analysis file\n", path);
+	result.prgHash = ok ? readLE32(data + 8) | ((uint64_t)readLE32(data + 12) << 32) : 0;
+	if (ok && (readLE32(data + 4) != cart.prgSize || result.prgHash != hashBytes(cart.prg, cart.prgSize, 0))) {
+		printf("%s was made from a different rom, ignoring it\n", path);
+		ok = false;
+	}
+	if (ok) {
+		result.prgSize = cart.prgSize;
+		result.flags = (uint8_t*)malloc(cart.prgSize);
+		result.blocks = (romBlock*)malloc(result.blockCount * sizeof(romBlock) + 1);
+		result.tables = (jumpTable*)malloc(result.tableCount * sizeof(jumpTable) + 1);
+		ok = result.flags && result.blocks && result.tables;
+	}
+	const uint8_t* p = data + ANALYSIS_HEADER;
+	uint32_t filled = 0;
+	for (uint32_t i = 0; ok && i < runs; i++, p += 3) {
+		uint16_t length = readLE16(p + 1);
+		ok = filled + length <= cart.prgSize;
+		if (ok) memset(result.flags + filled, p[0], length);
+		filled += length;
+	}
+	ok = ok && filled == cart.prgSize;
+	for (uint32_t i = 0; ok && i < result.blockCount; i++, p += 5) {
+		result.blocks[i] = { readLE16(p), readLE16(p + 2), p[4] };
+		ok = result.blocks[i].offset < cart.prgSize;
+	}
+	for (uint32_t i = 0; ok && i < result.tableCount; i++, p += 6) {
+		result.tables[i] = { readLE16(p), readLE16(p + 2), p[4], p[5] };
+	}
+	unmapFile(data, size, mapping);
+	if (!ok) {
+		destroyAnalysis(result);
+		return false;
+	}
+	return true;
+}
+
+void destroyAnalysis(romAnalysis& result) {
+	free(result.flags);
+	free(result.blocks);
+	free(result.tables);
+	memset(&result, 0, sizeof(result));
+}
@@ -0,0 +1,63 @@
+#ifndef nesanalysis
+#define nesanalysis
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cartridge.h"
+#include "cpu.h"
+
+//per prg byte, a byte with none of these set is data or was never reached
+#define CODE_OPCODE 0x01
+#define CODE_OPERAND 0x02
+#define CODE_BLOCK 0x04//first instruction of a basic block
+#define CODE_ENTRY 0x08//target of the reset, nmi or irq vector
+#define CODE_JUMPTABLE 0x10//address byte of a jump table entry
+
+//how a jump table is dispatched
+#define TABLE_JMP 0//addresses stored into a pointer and taken with JMP (ind)
+#define TABLE_RTS 1//addresses minus one pushed and taken with RTS
+
+/*
+sidecar file layout, all values little endian, offsets into prg rather than cpu addresses
+0x00 "NRA1"
+0x04 uint32 prg size
+0x08 uint64 hash of the prg it was made from, a stale sidecar is ignored
+0x10 uint32 flag runs, uint32 blocks, uint32 jump tables
+0x1C flag runs * { uint8 CODE_* flags, uint16 length }
+     blocks * { uint16 offset, uint16 bytes, uint8 instructions }
+     jump tables * { uint16 low byte offset, uint16 high byte offset, uint8 entries, uint8 TABLE_* }
+*/
+#define ANALYSIS_HEADER 0x1C
+#define ANALYSIS_EXT ".nra"//appended to the rom path
+
+struct romBlock {
+	uint16_t offset;
+	uint16_t bytes;
+	uint8_t instructions;
+};
+
+struct jumpTable {
+	uint16_t low;//offset of the first entry's low byte
+	uint16_t high;//and of its high byte, low + 1 for interleaved tables
+	uint8_t entries;
+	uint8_t kind;
+};
+
+struct romAnalysis {
+	uint32_t prgSize;
+	uint64_t prgHash;
+	uint8_t* flags;
+	romBlock* blocks;
+	uint32_t blockCount;
+	jumpTable* tables;
+	uint32_t tableCount;
+};
+
+//walks the code reachable from the vectors, data is whatever it never reaches
+bool analyzeROM(const cartridge&, romAnalysis&);
+bool saveAnalysis(const romAnalysis&, const char* path);
+//fails on a missing file quietly and on a sidecar for a different rom with a message
+bool loadAnalysis(const cartridge&, const char* path, romAnalysis&);
+void destroyAnalysis(romAnalysis&);
+
+#endif
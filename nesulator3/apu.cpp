@@ -0,0 +1,691 @@
+#include "apu.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+
+#define BLIP_PHASES 32
+#define BLIP_SCALE_BITS 14
+#define FRAME_4STEP_PERIOD 29830
+#define FRAME_5STEP_PERIOD 37282
+//used for timers that are not currently producing any output changes
+#define TIMER_IDLE 0xFFFFFFFF
+#define NOISE_BITS 15
+//powers of two of the noise step, enough for any 32 bit step count
+#define NOISE_JUMPS 32
+
+static const uint8_t lengthTable[32] = {
+	10, 254, 20, 2, 40, 4, 80, 6, 160, 8, 60, 10, 14, 12, 26, 14,
+	12, 16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30
+};
+
+static const uint8_t dutyTable[4] = { 0b01000000, 0b01100000, 0b01111000, 0b10011111 };
+
+static const uint8_t triangleTable[32] = {
+	15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+};
+
+static const uint16_t noiseTable[16] = {
+	4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068
+};
+
+static const uint16_t dmcTable[16] = {
+	428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54
+};
+
+//cpu cycle of each frame sequencer step relative to the start of the sequence
+static const uint32_t frameSteps[2][4] = {
+	{ 7457, 14913, 22371, 29829 },
+	{ 7457, 14913, 22371, 37281 }
+};
+
+static int16_t blipKernel[BLIP_PHASES][APU_BLIP_TAPS];
+static int32_t pulseMix[31];
+static int32_t tndMix[203];
+//noiseJump[mode][i][j] is bit j of the shift register after 2^i steps, as a column of the step matrix
+static uint16_t noiseJump[2][NOISE_JUMPS][NOISE_BITS];
+static bool tablesBuilt = false;
+
+/*
+###################################--- TABLES ---#######################################
+*/
+
+inline
+uint16_t clockLFSR(uint16_t reg, bool mode) {
+	uint16_t feedback = (reg ^ (reg >> (mode ? 6 : 1))) & 1;
+	return (reg >> 1) | (feedback << 14);
+}
+
+void buildAPUTables() {
+	if (tablesBuilt)
+		return;
+	//non linear mixer, scaled so a full scale output sits just under int16 range
+	pulseMix[0] = 0;
+	for (int i = 1; i < 31; i++) {
+		pulseMix[i] = (int32_t)(95.52 / (8128.0 / i + 100.0) * 28000.0);
+	}
+	tndMix[0] = 0;
+	for (int i = 1; i < 203; i++) {
+		tndMix[i] = (int32_t)(163.67 / (24329.0 / i + 100.0) * 28000.0);
+	}
+	//blackman windowed sinc step derivative, one row per sub sample phase
+	const double pi = 3.14159265358979323846;
+	for (int p = 0; p < BLIP_PHASES; p++) {
+		double frac = (double)p / BLIP_PHASES;
+		double row[APU_BLIP_TAPS];
+		double sum = 0;
+		for (int k = 0; k < APU_BLIP_TAPS; k++) {
+			double x = (k - APU_BLIP_TAPS / 2 + 1) - frac;
+			double n = (k + 1 - frac) / APU_BLIP_TAPS;
+			double window = 0.42 - 0.5 * cos(2 * pi * n) + 0.08 * cos(4 * pi * n);
+			double sinc = x == 0 ? 1.0 : sin(pi * x * 0.9) / (pi * x * 0.9);
+			row[k] = sinc * window;
+			sum += row[k];
+		}
+		int32_t total = 0;
+		for (int k = 0; k < APU_BLIP_TAPS; k++) {
+			blipKernel[p][k] = (int16_t)lround(row[k] / sum * (1 << BLIP_SCALE_BITS));
+			total += blipKernel[p][k];
+		}
+		//put any rounding error in the centre tap so every step integrates exactly
+		blipKernel[p][APU_BLIP_TAPS / 2 - 1] += (1 << BLIP_SCALE_BITS) - total;
+	}
+	for (int mode = 0; mode < 2; mode++) {
+		for (int j = 0; j < NOISE_BITS; j++) {
+			noiseJump[mode][0][j] = clockLFSR(1 << j, mode);
+		}
+		//squaring the step matrix, applying it to each of its own columns
+		for (int i = 1; i < NOISE_JUMPS; i++) {
+			for (int j = 0; j < NOISE_BITS; j++) {
+				uint16_t column = noiseJump[mode][i - 1][j], squared = 0;
+				for (int k = 0; k < NOISE_BITS; k++) {
+					if (column & (1 << k)) squared ^= noiseJump[mode][i - 1][k];
+				}
+				noiseJump[mode][i][j] = squared;
+			}
+		}
+	}
+	tablesBuilt = true;
+}
+
+/*
+###################################--- BLIP BUFFER ---#######################################
+*/
+
+//32.32 fixed point output samples per cpu cycle
+static const uint64_t blipFactor = ((uint64_t)APU_SAMPLE_RATE << 32) / APU_CLOCK_RATE;
+
+inline
+void blipAddDelta(apuBlip& blip, uint64_t frameTime, int32_t delta) {
+	uint64_t pos = blip.offset + frameTime * blipFactor;
+	size_t index = (size_t)(pos >> 32);
+	if (index >= APU_BUFFER_SIZE)
+		return;//caller has not been draining samples
+	const int16_t* kernel = blipKernel[(pos >> (32 - 5)) & (BLIP_PHASES - 1)];
+	int32_t* out = blip.buffer + index;
+	for (int k = 0; k < APU_BLIP_TAPS; k++) {
+		out[k] += kernel[k] * delta;
+	}
+}
+
+size_t blipReadSamples(apuBlip& blip, uint64_t frameTime, int16_t* out, size_t maxSamples) {
+	uint64_t end = blip.offset + frameTime * blipFactor;
+	size_t avail = (size_t)(end >> 32);
+	if (avail > APU_BUFFER_SIZE)
+		avail = APU_BUFFER_SIZE;
+	size_t written = 0;
+	for (size_t i = 0; i < avail; i++) {
+		blip.integrator += blip.buffer[i];
+		int32_t s = blip.integrator >> BLIP_SCALE_BITS;
+		//one pole high pass to remove the dc offset of the nes mixer
+		blip.dcLevel += (s - blip.dcLevel) >> 9;
+		s -= blip.dcLevel;
+		if (s > 32767) s = 32767;
+		if (s < -32768) s = -32768;
+		if (out && written < maxSamples) {
+			out[written++] = (int16_t)s;
+		}
+	}
+	memmove(blip.buffer, blip.buffer + avail, APU_BLIP_TAPS * sizeof(int32_t));
+	memset(blip.buffer + APU_BLIP_TAPS, 0, avail * sizeof(int32_t));
+	blip.offset = end - ((uint64_t)avail << 32);
+	return written;
+}
+
+/*
+###################################--- CHANNEL UNITS ---#######################################
+*/
+
+inline
+void clockEnvelope(apuEnvelope& env) {
+	if (env.start) {
+		env.start = false;
+		env.decay = 15;
+		env.divider = env.volume;
+	}
+	else if (env.divider == 0) {
+		env.divider = env.volume;
+		if (env.decay > 0) env.decay--;
+		else if (env.loop) env.decay = 15;
+	}
+	else {
+		env.divider--;
+	}
+}
+
+inline
+uint8_t envelopeVolume(apuEnvelope& env) {
+	return env.constant ? env.volume : env.decay;
+}
+
+uint16_t sweepTarget(apuPulse& pulse, int channel) {
+	uint16_t change = pulse.timerPeriod >> pulse.sweepShift;
+	if (pulse.sweepNegate) {
+		//pulse 1 uses ones complement negation
+		return pulse.timerPeriod - change - (channel == 0 ? 1 : 0);
+	}
+	return pulse.timerPeriod + change;
+}
+
+inline
+bool pulseMuted(apuPulse& pulse, int channel) {
+	return pulse.timerPeriod < 8 || (!pulse.sweepNegate && sweepTarget(pulse, channel) > 0x7FF);
+}
+
+void clockQuarterFrame(apu& _apu) {
+	clockEnvelope(_apu.pulse[0].envelope);
+	clockEnvelope(_apu.pulse[1].envelope);
+	clockEnvelope(_apu.noise.envelope);
+	apuTriangle& tri = _apu.triangle;
+	if (tri.linearReloadFlag) tri.linearCounter = tri.linearReload;
+	else if (tri.linearCounter > 0) tri.linearCounter--;
+	if (!tri.control) tri.linearReloadFlag = false;
+}
+
+void clockHalfFrame(apu& _apu) {
+	for (int i = 0; i < 2; i++) {
+		apuPulse& pulse = _apu.pulse[i];
+		if (!pulse.envelope.loop && pulse.lengthCounter > 0) pulse.lengthCounter--;
+		if (pulse.sweepDivider == 0 && pulse.sweepEnabled && pulse.sweepShift > 0 && !pulseMuted(pulse, i)) {
+			pulse.timerPeriod = sweepTarget(pulse, i);
+		}
+		if (pulse.sweepDivider == 0 || pulse.sweepReload) {
+			pulse.sweepDivider = pulse.sweepPeriod;
+			pulse.sweepReload = false;
+		}
+		else {
+			pulse.sweepDivider--;
+		}
+	}
+	if (!_apu.triangle.control && _apu.triangle.lengthCounter > 0) _apu.triangle.lengthCounter--;
+	if (!_apu.noise.envelope.loop && _apu.noise.lengthCounter > 0) _apu.noise.lengthCounter--;
+}
+
+void clockFrameSequencer(apu& _apu) {
+	uint8_t step = _apu.frameStep;
+	clockQuarterFrame(_apu);
+	if (step & 1) clockHalfFrame(_apu);
+	if (step == 3 && _apu.frameMode == 0 && !_apu.irqInhibit) _apu.frameIRQ = true;
+	if (step == 3) {
+		uint32_t period = _apu.frameMode ? FRAME_5STEP_PERIOD : FRAME_4STEP_PERIOD;
+		_apu.frameStep = 0;
+		_apu.frameCounter = period - frameSteps[_apu.frameMode][3] + frameSteps[_apu.frameMode][0];
+	}
+	else {
+		_apu.frameStep++;
+		_apu.frameCounter = frameSteps[_apu.frameMode][step + 1] - frameSteps[_apu.frameMode][step];
+	}
+}
+
+void dmcFetch(apu& _apu) {
+	apuDMC& dmc = _apu.dmc;
+	if (!dmc.bufferEmpty || dmc.bytesRemaining == 0)
+		return;
+	dmc.sampleBuffer = _apu.dmcread ? _apu.dmcread(_apu.dmcdata, dmc.currentAddress) : 0;
+	dmc.bufferEmpty = false;
+	dmc.currentAddress = dmc.currentAddress == 0xFFFF ? 0x8000 : dmc.currentAddress + 1;
+	if (--dmc.bytesRemaining == 0) {
+		if (dmc.loop) {
+			dmc.currentAddress = dmc.sampleAddress;
+			dmc.bytesRemaining = dmc.sampleLength;
+		}
+		else if (dmc.irqEnabled) {
+			dmc.irqFlag = true;
+		}
+	}
+}
+
+void clockDMC(apu& _apu) {
+	apuDMC& dmc = _apu.dmc;
+	if (!dmc.silence) {
+		if (dmc.shiftReg & 1) {
+			if (dmc.outputLevel <= 125) dmc.outputLevel += 2;
+		}
+		else {
+			if (dmc.outputLevel >= 2) dmc.outputLevel -= 2;
+		}
+	}
+	dmc.shiftReg >>= 1;
+	if (--dmc.bitsRemaining == 0) {
+		dmc.bitsRemaining = 8;
+		if (dmc.bufferEmpty) {
+			dmc.silence = true;
+		}
+		else {
+			dmc.silence = false;
+			dmc.shiftReg = dmc.sampleBuffer;
+			dmc.bufferEmpty = true;
+			dmcFetch(_apu);
+		}
+	}
+}
+
+int32_t mixOutput(apu& _apu) {
+	uint8_t p[2];
+	for (int i = 0; i < 2; i++) {
+		apuPulse& pulse = _apu.pulse[i];
+		bool high = (dutyTable[pulse.duty] << pulse.dutyPos) & 0x80;
+		p[i] = (high && pulse.lengthCounter && !pulseMuted(pulse, i)) ? envelopeVolume(pulse.envelope) : 0;
+	}
+	uint8_t t = triangleTable[_apu.triangle.seqPos];
+	uint8_t n = (!(_apu.noise.shiftReg & 1) && _apu.noise.lengthCounter) ? envelopeVolume(_apu.noise.envelope) : 0;
+	return pulseMix[p[0] + p[1]] + tndMix[3 * t + 2 * n + _apu.dmc.outputLevel];
+}
+
+/*
+###################################--- CATCH UP ---#######################################
+*/
+
+inline
+uint32_t triangleReload(apuTriangle& tri) {
+	//ultrasonic periods are silenced rather than stepped every cycle
+	return tri.timerPeriod < 2 ? TIMER_IDLE : tri.timerPeriod + 1;
+}
+
+//the lfsr is linear, so n steps are applied as a product of the precomputed 2^i step matrices
+uint16_t jumpLFSR(uint16_t reg, bool mode, uint32_t steps) {
+	for (int bit = 0; steps; bit++, steps >>= 1) {
+		if (!(steps & 1))
+			continue;
+		const uint16_t* jump = noiseJump[mode][bit];
+		uint16_t next = 0;
+		for (int j = 0; j < NOISE_BITS; j++) {
+			if (reg & (1 << j)) next ^= jump[j];
+		}
+		reg = next;
+	}
+	return reg;
+}
+
+//the wake functions give the cpu cycles until a channel's output level can next change,
+//TIMER_IDLE while it cannot change until a register write or frame sequencer step
+uint32_t pulseWake(apuPulse& pulse, int channel) {
+	if (!pulse.lengthCounter || !envelopeVolume(pulse.envelope) || pulseMuted(pulse, channel))
+		return TIMER_IDLE;
+	uint8_t duty = dutyTable[pulse.duty];
+	bool high = (duty << pulse.dutyPos) & 0x80;
+	uint32_t reload = (pulse.timerPeriod + 1) * 2;
+	uint32_t wake = pulse.timerCounter;
+	//every duty pattern has both levels, so this stops within 7 steps
+	for (uint8_t pos = (pulse.dutyPos + 1) & 7; (bool)((duty << pos) & 0x80) == high; pos = (pos + 1) & 7) {
+		wake += reload;
+	}
+	return wake;
+}
+
+inline
+uint32_t triangleWake(apuTriangle& tri) {
+	return tri.lengthCounter && tri.linearCounter ? tri.timerCounter : TIMER_IDLE;
+}
+
+uint32_t noiseWake(apuNoise& noise) {
+	if (!noise.lengthCounter || !envelopeVolume(noise.envelope))
+		return TIMER_IDLE;
+	//a nonzero 15 bit register cannot keep bit 0 for more than 16 steps
+	uint32_t wake = noise.timerCounter;
+	for (uint16_t reg = clockLFSR(noise.shiftReg, noise.mode); !((reg ^ noise.shiftReg) & 1); reg = clockLFSR(reg, noise.mode)) {
+		wake += noise.timerPeriod;
+	}
+	return wake;
+}
+
+inline
+uint32_t dmcWake(apuDMC& dmc) {
+	if (!dmc.silence)
+		return dmc.timerCounter;
+	//a silent output unit only matters again when it reaches the end of the byte and takes the buffer
+	if (!dmc.bufferEmpty)
+		return dmc.timerCounter + (dmc.bitsRemaining - 1) * dmc.timerPeriod;
+	return TIMER_IDLE;
+}
+
+//the advance functions move a channel s cycles on, however many timer periods that spans.
+//periods cannot change inside s since every register write and frame step ends a run
+void advancePulse(apuPulse& pulse, uint32_t s) {
+	if (s < pulse.timerCounter) {
+		pulse.timerCounter -= s;
+		return;
+	}
+	uint32_t reload = (pulse.timerPeriod + 1) * 2;
+	uint32_t over = s - pulse.timerCounter;
+	pulse.dutyPos = (pulse.dutyPos + 1 + over / reload) & 7;
+	pulse.timerCounter = reload - over % reload;
+}
+
+void advanceTriangle(apuTriangle& tri, uint32_t s) {
+	if (tri.timerCounter == TIMER_IDLE)
+		return;
+	if (s < tri.timerCounter) {
+		tri.timerCounter -= s;
+		return;
+	}
+	uint32_t reload = triangleReload(tri);
+	uint32_t over = s - tri.timerCounter;
+	uint32_t steps = 1;
+	if (reload == TIMER_IDLE) {
+		tri.timerCounter = TIMER_IDLE;
+	}
+	else {
+		steps += over / reload;
+		tri.timerCounter = reload - over % reload;
+	}
+	if (tri.lengthCounter && tri.linearCounter) tri.seqPos = (tri.seqPos + steps) & 31;
+}
+
+void advanceNoise(apuNoise& noise, uint32_t s) {
+	if (s < noise.timerCounter) {
+		noise.timerCounter -= s;
+		return;
+	}
+	uint32_t over = s - noise.timerCounter;
+	noise.shiftReg = jumpLFSR(noise.shiftReg, noise.mode, 1 + over / noise.timerPeriod);
+	noise.timerCounter = noise.timerPeriod - over % noise.timerPeriod;
+}
+
+void advanceDMC(apu& _apu, uint32_t s) {
+	apuDMC& dmc = _apu.dmc;
+	if (s < dmc.timerCounter) {
+		dmc.timerCounter -= s;
+		return;
+	}
+	uint32_t over = s - dmc.timerCounter;
+	uint32_t clocks = 1 + over / dmc.timerPeriod;
+	dmc.timerCounter = dmc.timerPeriod - over % dmc.timerPeriod;
+	if (dmc.silence && dmc.bufferEmpty) {
+		//nothing to play and nothing to fetch, only the shift register and bit count move
+		dmc.shiftReg = clocks >= 8 ? 0 : dmc.shiftReg >> clocks;
+		dmc.bitsRemaining = (uint8_t)((dmc.bitsRemaining + 7 - clocks % 8) % 8 + 1);
+		return;
+	}
+	while (clocks--) {
+		clockDMC(_apu);
+	}
+}
+
+inline
+void updateOutput(apu& _apu) {
+	int32_t out = mixOutput(_apu);
+	if (out != _apu.lastOutput) {
+		if (!_apu.muted)
+			blipAddDelta(*_apu.blip, _apu.time - _apu.frameStart, out - _apu.lastOutput);
+		_apu.lastOutput = out;
+	}
+}
+
+//runs from one point where the mix can change to the next rather than cycle by cycle,
+//silent channels are carried along in bulk and never end a run on their own
+void runAPU(apu& _apu, uint64_t target) {
+	while (_apu.time < target) {
+		uint64_t gap = target - _apu.time;
+		uint32_t next = _apu.frameCounter;
+		uint32_t wake;
+		if ((wake = pulseWake(_apu.pulse[0], 0)) < next) next = wake;
+		if ((wake = pulseWake(_apu.pulse[1], 1)) < next) next = wake;
+		if ((wake = triangleWake(_apu.triangle)) < next) next = wake;
+		if ((wake = noiseWake(_apu.noise)) < next) next = wake;
+		if ((wake = dmcWake(_apu.dmc)) < next) next = wake;
+		bool event = next <= gap;
+		uint32_t s = event ? next : (uint32_t)gap;
+		_apu.time += s;
+		_apu.frameCounter -= s;
+		advancePulse(_apu.pulse[0], s);
+		advancePulse(_apu.pulse[1], s);
+		advanceTriangle(_apu.triangle, s);
+		advanceNoise(_apu.noise, s);
+		advanceDMC(_apu, s);
+		if (_apu.frameCounter == 0) {
+			clockFrameSequencer(_apu);
+		}
+		if (event)
+			updateOutput(_apu);
+	}
+}
+
+/*
+###################################--- REGISTERS ---#######################################
+*/
+
+void writeEnvelope(apuEnvelope& env, uint8_t val) {
+	env.loop = val & 0x20;
+	env.constant = val & 0x10;
+	env.volume = val & 0x0F;
+}
+
+uint8_t apuRead(void* myapu, uint16_t address) {
+	apu* _apu = (apu*)myapu;
+	if (address != 0x15)
+		return 0;
+	catchUpAPU(*_apu);
+	uint8_t status = 0;
+	if (_apu->pulse[0].lengthCounter) status |= 0x01;
+	if (_apu->pulse[1].lengthCounter) status |= 0x02;
+	if (_apu->triangle.lengthCounter) status |= 0x04;
+	if (_apu->noise.lengthCounter) status |= 0x08;
+	if (_apu->dmc.bytesRemaining) status |= 0x10;
+	if (_apu->frameIRQ) status |= 0x40;
+	if (_apu->dmc.irqFlag) status |= 0x80;
+	_apu->frameIRQ = false;
+	if (_apu->events) scheduleEvent(*_apu->events, EVENT_APU_IRQ, nextAPUIRQ(*_apu));
+	return status;
+}
+
+void apuWrite(void* myapu, uint16_t address, uint8_t val) {
+	apu* _apu = (apu*)myapu;
+	catchUpAPU(*_apu);
+	switch (address) {
+	case 0x00:
+	case 0x04: {
+		apuPulse& pulse = _apu->pulse[address >> 2];
+		pulse.duty = val >> 6;
+		writeEnvelope(pulse.envelope, val);
+		break;
+	}
+	case 0x01:
+	case 0x05: {
+		apuPulse& pulse = _apu->pulse[address >> 2];
+		pulse.sweepEnabled = val & 0x80;
+		pulse.sweepPeriod = (val >> 4) & 7;
+		pulse.sweepNegate = val & 0x08;
+		pulse.sweepShift = val & 7;
+		pulse.sweepReload = true;
+		break;
+	}
+	case 0x02:
+	case 0x06: {
+		apuPulse& pulse = _apu->pulse[address >> 2];
+		pulse.timerPeriod = (pulse.timerPeriod & 0x700) | val;
+		break;
+	}
+	case 0x03:
+	case 0x07: {
+		apuPulse& pulse = _apu->pulse[address >> 2];
+		pulse.timerPeriod = (pulse.timerPeriod & 0xFF) | ((val & 7) << 8);
+		if (pulse.enabled) pulse.lengthCounter = lengthTable[val >> 3];
+		pulse.envelope.start = true;
+		pulse.dutyPos = 0;
+		break;
+	}
+	case 0x08:
+		_apu->triangle.control = val & 0x80;
+		_apu->triangle.linearReload = val & 0x7F;
+		break;
+	case 0x0A:
+		_apu->triangle.timerPeriod = (_apu->triangle.timerPeriod & 0x700) | val;
+		if (_apu->triangle.timerCounter == TIMER_IDLE) _apu->triangle.timerCounter = triangleReload(_apu->triangle);
+		break;
+	case 0x0B:
+		_apu->triangle.timerPeriod = (_apu->triangle.timerPeriod & 0xFF) | ((val & 7) << 8);
+		if (_apu->triangle.enabled) _apu->triangle.lengthCounter = lengthTable[val >> 3];
+		_apu->triangle.linearReloadFlag = true;
+		if (_apu->triangle.timerCounter == TIMER_IDLE) _apu->triangle.timerCounter = triangleReload(_apu->triangle);
+		break;
+	case 0x0C:
+		writeEnvelope(_apu->noise.envelope, val);
+		break;
+	case 0x0E:
+		_apu->noise.mode = val & 0x80;
+		_apu->noise.timerPeriod = noiseTable[val & 0x0F];
+		break;
+	case 0x0F:
+		if (_apu->noise.enabled) _apu->noise.lengthCounter = lengthTable[val >> 3];
+		_apu->noise.envelope.start = true;
+		break;
+	case 0x10:
+		_apu->dmc.irqEnabled = val & 0x80;
+		_apu->dmc.loop = val & 0x40;
+		_apu->dmc.timerPeriod = dmcTable[val & 0x0F];
+		if (!_apu->dmc.irqEnabled) _apu->dmc.irqFlag = false;
+		break;
+	case 0x11:
+		_apu->dmc.outputLevel = val & 0x7F;
+		break;
+	case 0x12:
+		_apu->dmc.sampleAddress = 0xC000 | (val << 6);
+		break;
+	case 0x13:
+		_apu->dmc.sampleLength = (val << 4) | 1;
+		break;
+	case 0x15:
+		_apu->pulse[0].enabled = val & 0x01;
+		_apu->pulse[1].enabled = val & 0x02;
+		_apu->triangle.enabled = val & 0x04;
+		_apu->noise.enabled = val & 0x08;
+		if (!_apu->pulse[0].enabled) _apu->pulse[0].lengthCounter = 0;
+		if (!_apu->pulse[1].enabled) _apu->pulse[1].lengthCounter = 0;
+		if (!_apu->triangle.enabled) _apu->triangle.lengthCounter = 0;
+		if (!_apu->noise.enabled) _apu->noise.lengthCounter = 0;
+		_apu->dmc.irqFlag = false;
+		if (!(val & 0x10)) {
+			_apu->dmc.bytesRemaining = 0;
+		}
+		else if (_apu->dmc.bytesRemaining == 0) {
+			_apu->dmc.currentAddress = _apu->dmc.sampleAddress;
+			_apu->dmc.bytesRemaining = _apu->dmc.sampleLength;
+			dmcFetch(*_apu);
+		}
+		break;
+	case 0x17:
+		_apu->frameMode = val >> 7;
+		_apu->irqInhibit = val & 0x40;
+		if (_apu->irqInhibit) _apu->frameIRQ = false;
+		_apu->frameStep = 0;
+		_apu->frameCounter = frameSteps[_apu->frameMode][0];
+		if (_apu->frameMode) {
+			clockQuarterFrame(*_apu);
+			clockHalfFrame(*_apu);
+		}
+		break;
+	}
+	//a write can change the mix by itself, the run loop only looks again at the next unit event
+	updateOutput(*_apu);
+	if (_apu->events) scheduleEvent(*_apu->events, EVENT_APU_IRQ, nextAPUIRQ(*_apu));
+}
+
+/*
+###################################--- PUBLIC FUNCTIONS ---#######################################
+*/
+
+bool createAPU(apu& _apu, const uint64_t* clock) {
+	buildAPUTables();
+	memset(&_apu, 0, sizeof(apu));
+	_apu.blip = (apuBlip*)calloc(1, sizeof(apuBlip));
+	_apu.noise.shiftReg = 1;
+	_apu.noise.timerPeriod = noiseTable[0];
+	_apu.noise.timerCounter = noiseTable[0];
+	_apu.dmc.timerPeriod = dmcTable[0];
+	_apu.dmc.timerCounter = dmcTable[0];
+	_apu.dmc.bitsRemaining = 8;
+	_apu.dmc.bufferEmpty = true;
+	_apu.dmc.silence = true;
+	_apu.pulse[0].timerCounter = 2;
+	_apu.pulse[1].timerCounter = 2;
+	_apu.triangle.timerCounter = TIMER_IDLE;
+	_apu.frameCounter = frameSteps[0][0];
+	_apu.clock = clock;
+	_apu.time = clock ? *clock : 0;
+	_apu.frameStart = _apu.time;
+	_apu.lastOutput = mixOutput(_apu);
+	_apu.muted = false;
+	_apu.dmcread = nullptr;
+	_apu.dmcdata = nullptr;
+	return _apu.blip;
+}
+
+//channel state is copied, samples the parent has not read out yet stay with the parent
+bool forkAPU(apu& child, const apu& parent, const uint64_t* clock) {
+	child = parent;
+	child.clock = clock;
+	child.blip = (apuBlip*)calloc(1, sizeof(apuBlip));
+	return child.blip;
+}
+
+void createAPUDevice(device816& dev, apu& _apu) {
+	dev.data = &_apu;
+	dev.start = 0x4000;
+	dev.length = 0x18;
+	dev.readfun = &(apuRead);
+	dev.writefun = &(apuWrite);
+}
+
+void catchUpAPU(apu& _apu) {
+	if (_apu.clock)
+		runAPU(_apu, *_apu.clock);
+}
+
+bool apuIRQ(apu& _apu) {
+	catchUpAPU(_apu);
+	return _apu.frameIRQ || _apu.dmc.irqFlag;
+}
+
+//a lower bound rather than exact for the dmc, the caller checks apuIRQ when it arrives and asks again
+uint64_t nextAPUIRQ(apu& _apu) {
+	catchUpAPU(_apu);
+	if (_apu.frameIRQ || _apu.dmc.irqFlag)
+		return _apu.time;
+	uint64_t next = EVENT_NEVER;
+	if (_apu.frameMode == 0 && !_apu.irqInhibit)
+		next = _apu.time + _apu.frameCounter + frameSteps[0][3] - frameSteps[0][_apu.frameStep];
+	const apuDMC& dmc = _apu.dmc;
+	if (dmc.irqEnabled && !dmc.loop && dmc.bytesRemaining) {
+		//the last byte cannot be fetched before the output unit has shifted out everything ahead of it
+		uint64_t fetch = _apu.time + dmc.timerCounter + (uint64_t)(dmc.bitsRemaining ? dmc.bitsRemaining - 1 : 0) * dmc.timerPeriod
+			+ (uint64_t)(dmc.bytesRemaining - 1) * 8 * dmc.timerPeriod;
+		if (fetch < next) next = fetch;
+	}
+	return next;
+}
+
+size_t endAPUFrame(apu& _apu, int16_t* out, size_t maxSamples) {
+	catchUpAPU(_apu);
+	size_t written = blipReadSamples(*_apu.blip, _apu.time - _apu.frameStart, out, maxSamples);
+	_apu.frameStart = _apu.time;
+	return written;
+}
+
+void destroyAPU(apu& _apu) {
+	free(_apu.blip);
+	_apu.blip = nullptr;
+	_apu.clock = nullptr;
+	_apu.dmcread = nullptr;
+}
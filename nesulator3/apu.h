@@ -0,0 +1,118 @@
+#ifndef nesapu
+#define nesapu
+
+#include <stdint.h>
+#include <stddef.h>
+#include "emulatorGlue.h"
+#include "scheduler.h"
+
+#define APU_SAMPLE_RATE 48000
+#define APU_CLOCK_RATE 1789773
+//samples held between endAPUFrame calls, comfortably more than one frame (~800)
+#define APU_BUFFER_SIZE 4096
+#define APU_BLIP_TAPS 16
+
+struct apuEnvelope {
+	uint8_t volume;//constant volume or envelope period
+	uint8_t divider;
+	uint8_t decay;
+	bool constant;
+	bool loop;//shares the length counter halt bit
+	bool start;
+};
+
+struct apuPulse {
+	uint8_t duty;
+	uint8_t dutyPos;
+	uint16_t timerPeriod;
+	uint32_t timerCounter;//cpu cycles until the next sequencer step
+	uint8_t lengthCounter;
+	apuEnvelope envelope;
+	bool sweepEnabled;
+	bool sweepNegate;
+	bool sweepReload;
+	uint8_t sweepPeriod;
+	uint8_t sweepShift;
+	uint8_t sweepDivider;
+	bool enabled;
+};
+
+struct apuTriangle {
+	uint8_t seqPos;
+	uint16_t timerPeriod;
+	uint32_t timerCounter;
+	uint8_t lengthCounter;
+	uint8_t linearCounter;
+	uint8_t linearReload;
+	bool linearReloadFlag;
+	bool control;
+	bool enabled;
+};
+
+struct apuNoise {
+	bool mode;
+	uint16_t shiftReg;
+	uint16_t timerPeriod;
+	uint32_t timerCounter;
+	uint8_t lengthCounter;
+	apuEnvelope envelope;
+	bool enabled;
+};
+
+struct apuDMC {
+	bool irqEnabled;
+	bool irqFlag;
+	bool loop;
+	uint16_t timerPeriod;
+	uint32_t timerCounter;
+	uint8_t outputLevel;
+	uint16_t sampleAddress;
+	uint16_t sampleLength;
+	uint16_t currentAddress;
+	uint16_t bytesRemaining;
+	uint8_t sampleBuffer;
+	bool bufferEmpty;
+	uint8_t shiftReg;
+	uint8_t bitsRemaining;
+	bool silence;
+};
+
+//band limited step buffer, deltas are added at cpu cycle resolution and integrated on read out
+struct apuBlip {
+	int32_t buffer[APU_BUFFER_SIZE + APU_BLIP_TAPS];
+	uint64_t offset;//32.32 fixed point sample position of the frame start
+	int32_t integrator;
+	int32_t dcLevel;
+};
+
+struct apu {
+	apuPulse pulse[2];
+	apuTriangle triangle;
+	apuNoise noise;
+	apuDMC dmc;
+	uint8_t frameMode;
+	uint8_t frameStep;
+	uint32_t frameCounter;//cpu cycles until the next frame sequencer step
+	bool irqInhibit;
+	bool frameIRQ;
+	uint64_t time;//cpu cycle the apu has been run up to
+	uint64_t frameStart;//cpu cycle the current audio frame started on
+	const uint64_t* clock;//cpu cycle counter the apu catches up to
+	int32_t lastOutput;
+	apuBlip* blip;//per machine, forks start with an empty buffer
+	scheduler* events;//optional, kept told of the earliest cycle an irq can assert
+	bool muted;//channels still run but nothing reaches the blip buffer, for frames that are thrown away
+	uint8_t(*dmcread)(void*, uint16_t);//data, address
+	void* dmcdata;
+};
+
+bool createAPU(apu&, const uint64_t* clock);
+bool forkAPU(apu& child, const apu& parent, const uint64_t* clock);
+void createAPUDevice(device816&, apu&);
+void catchUpAPU(apu&);
+bool apuIRQ(apu&);
+uint64_t nextAPUIRQ(apu&);
+size_t endAPUFrame(apu&, int16_t* out, size_t maxSamples);
+void destroyAPU(apu&);
+
+#endif
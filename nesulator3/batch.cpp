@@ -0,0 +1,399 @@
+#include "batch.h"
+#include "headless.h"
+
+#include <stdio.h>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+bool loadManifest(const char* path, batchJob*& jobs, uint32_t& count) {
+	jobs = nullptr;
+	count = 0;
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		printf("could not open manifest %s\n", path);
+		return false;
+	}
+	char line[2048], rom[1024], movie[1024];
+	uint32_t size = 0, lineNo = 0;
+	bool ok = true;
+	while (ok && fgets(line, sizeof(line), f)) {
+		unsigned long long limit = 0;
+		lineNo++;
+		int fields = sscanf(line, " %1023s %1023s %llu", rom, movie, &limit);
+		if (fields < 1 || rom[0] == '#')
+			continue;
+		if (fields < 2) {
+			printf("%s line %u needs a rom and a movie\n", path, lineNo);
+			ok = false;
+			break;
+		}
+		if (count == size) {
+			size = size ? size * 2 : 64;
+			batchJob* grown = (batchJob*)realloc(jobs, size * sizeof(batchJob));
+			if (!grown) {
+				ok = false;
+				break;
+			}
+			jobs = grown;
+		}
+		batchJob& job = jobs[count];
+		job.rom = (char*)malloc(strlen(rom) + 1);
+		job.movie = (char*)malloc(strlen(movie) + 1);
+		job.cycleLimit = fields > 2 ? limit : 0;
+		count++;
+		if (!job.rom || !job.movie) {
+			ok = false;
+			break;
+		}
+		strcpy(job.rom, rom);
+		strcpy(job.movie, movie);
+	}
+	fclose(f);
+	if (!ok) {
+		destroyManifest(jobs, count);
+		jobs = nullptr;
+		count = 0;
+	}
+	return ok;
+}
+
+void destroyManifest(batchJob* jobs, uint32_t count) {
+	for (uint32_t i = 0; i < count; i++) {
+		free(jobs[i].rom);
+		free(jobs[i].movie);
+	}
+	free(jobs);
+}
+
+void putLE(uint8_t* p, uint64_t value, uint8_t bytes) {
+	for (uint8_t i = 0; i < bytes; i++) {
+		p[i] = (uint8_t)(value >> (8 * i));
+	}
+}
+
+uint64_t getLE(const uint8_t* p, uint8_t bytes) {
+	uint64_t value = 0;
+	for (uint8_t i = 0; i < bytes; i++) {
+		value |= (uint64_t)p[i] << (8 * i);
+	}
+	return value;
+}
+
+void packBatchResult(const batchResult& result, uint8_t* record) {
+	memset(record, 0, BATCH_RECORD);
+	putLE(record, result.job, 4);
+	record[4] = result.status;
+	record[5] = result.signal;
+	putLE(record + 0x08, result.frames, 4);
+	putLE(record + 0x0C, result.cycles, 8);
+	putLE(record + 0x14, result.ramHash, 8);
+	putLE(record + 0x1C, result.frameHash, 8);
+	putLE(record + 0x24, result.stateHash, 8);
+}
+
+void unpackBatchResult(const uint8_t* record, batchResult& result) {
+	result.job = (uint32_t)getLE(record, 4);
+	result.status = record[4];
+	result.signal = record[5];
+	result.frames = (uint32_t)getLE(record + 0x08, 4);
+	result.cycles = getLE(record + 0x0C, 8);
+	result.ramHash = getLE(record + 0x14, 8);
+	result.frameHash = getLE(record + 0x1C, 8);
+	result.stateHash = getLE(record + 0x24, 8);
+}
+
+//each job is a fresh machine from createNES, so one job can not leave state behind for the next
+void runBatchJob(const batchJob& job, uint32_t index, batchResult& result) {
+	replayResult replay;
+	memset(&result, 0, sizeof(result));
+	result.job = index;
+	if (!replayMovie(job.rom, job.movie, job.cycleLimit, false, replay)) {
+		result.status = BATCH_FAILED;
+		return;
+	}
+	result.status = replay.completed ? BATCH_COMPLETED : BATCH_LIMIT;
+	result.frames = replay.frames;
+	result.cycles = replay.cycles;
+	result.ramHash = replay.ramHash;
+	result.frameHash = replay.frameHash;
+	result.stateHash = replay.stateHash;
+}
+
+void tallyResult(batchSummary& summary, batchResult* results, const batchResult& result) {
+	summary.counts[result.status]++;
+	summary.cycles += result.cycles;
+	if (results)
+		results[result.job] = result;
+}
+
+#ifdef _WIN32
+//no fork on windows, the jobs run one after another in this process, a crash ends the batch and
+//there is nothing to enforce a deadline on
+bool runBatch(const batchJob* jobs, uint32_t count, uint32_t workers, double deadline, batchResult* results, batchSummary& summary) {
+	memset(&summary, 0, sizeof(summary));
+	summary.jobs = count;
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < count; i++) {
+		batchResult result;
+		runBatchJob(jobs[i], i, result);
+		tallyResult(summary, results, result);
+	}
+	summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return true;
+}
+#else
+#define NO_JOB UINT32_MAX
+#define NO_WORKER -1//slot to be started or restarted
+#define RETIRED -2//slot that could not be started, left empty
+
+struct batchWorker {
+	pid_t pid;
+	int fd;//coordinator end of the socket pair, job indices go out and records come back
+	uint32_t job;//in flight, NO_JOB when idle
+	std::chrono::steady_clock::time_point deadline;//of the job in flight
+	uint8_t failedDispatches;//in a row, each on a freshly started worker
+};
+
+bool readFull(int fd, void* data, size_t length) {
+	uint8_t* p = (uint8_t*)data;
+	while (length) {
+		ssize_t got = read(fd, p, length);
+		if (got <= 0)
+			return false;
+		p += got;
+		length -= (size_t)got;
+	}
+	return true;
+}
+
+bool writeFull(int fd, const void* data, size_t length) {
+	const uint8_t* p = (const uint8_t*)data;
+	while (length) {
+		ssize_t put = write(fd, p, length);
+		if (put <= 0)
+			return false;
+		p += put;
+		length -= (size_t)put;
+	}
+	return true;
+}
+
+//a worker takes job indices until the coordinator closes its end
+void workerLoop(int fd, const batchJob* jobs, uint32_t count) {
+	uint8_t index[4];
+	while (readFull(fd, index, sizeof(index))) {
+		uint32_t job = (uint32_t)getLE(index, 4);
+		batchResult result;
+		uint8_t record[BATCH_RECORD];
+		if (job >= count)
+			break;
+		runBatchJob(jobs[job], job, result);
+		packBatchResult(result, record);
+		if (!writeFull(fd, record, sizeof(record)))
+			break;
+	}
+}
+
+bool spawnWorker(batchWorker* workers, uint32_t slot, uint32_t workerCount, const batchJob* jobs, uint32_t count) {
+	int fds[2];
+	workers[slot].pid = NO_WORKER;
+	workers[slot].fd = -1;
+	workers[slot].job = NO_JOB;
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		return false;
+	//anything still buffered would otherwise be printed again by the child
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		for (uint32_t i = 0; i < workerCount; i++) {
+			if (i != slot && workers[i].fd >= 0)
+				close(workers[i].fd);
+		}
+		workerLoop(fds[1], jobs, count);
+		fflush(stdout);
+		_exit(0);
+	}
+	close(fds[1]);
+	workers[slot].pid = pid;
+	workers[slot].fd = fds[0];
+	return true;
+}
+
+//the job only counts as the worker's once the worker has been sent it
+bool dispatchJob(batchWorker& worker, uint32_t job, double deadline) {
+	uint8_t index[4];
+	putLE(index, job, 4);
+	if (!writeFull(worker.fd, index, sizeof(index)))
+		return false;
+	worker.job = job;
+	worker.deadline = std::chrono::steady_clock::now()
+		+ std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(deadline));
+	return true;
+}
+
+//reaps a worker that is gone or was killed and reports the job it was running with the given status
+void reapWorker(batchWorker& worker, uint8_t jobStatus, batchSummary& summary, batchResult* results) {
+	int status = 0;
+	close(worker.fd);
+	waitpid(worker.pid, &status, 0);
+	if (worker.job != NO_JOB) {
+		batchResult result;
+		memset(&result, 0, sizeof(result));
+		result.job = worker.job;
+		result.status = jobStatus;
+		result.signal = jobStatus == BATCH_CRASHED && WIFSIGNALED(status) ? (uint8_t)WTERMSIG(status) : 0;
+		tallyResult(summary, results, result);
+	}
+	worker.pid = NO_WORKER;
+	worker.fd = -1;
+	worker.job = NO_JOB;
+}
+
+//milliseconds until the first deadline of a job in flight, -1 for none
+int pollTimeout(const batchWorker* workers, uint32_t workerCount, double deadline) {
+	if (deadline <= 0)
+		return -1;
+	auto now = std::chrono::steady_clock::now();
+	int64_t soonest = -1;
+	for (uint32_t i = 0; i < workerCount; i++) {
+		if (workers[i].pid < 0 || workers[i].job == NO_JOB)
+			continue;
+		int64_t left = std::chrono::duration_cast<std::chrono::milliseconds>(workers[i].deadline - now).count() + 1;
+		if (left < 0)
+			left = 0;
+		if (soonest < 0 || left < soonest)
+			soonest = left;
+	}
+	return soonest > INT32_MAX ? INT32_MAX : (int)soonest;
+}
+
+bool runBatch(const batchJob* jobs, uint32_t count, uint32_t workerCount, double deadline, batchResult* results, batchSummary& summary) {
+	memset(&summary, 0, sizeof(summary));
+	summary.jobs = count;
+	if (!workerCount)
+		workerCount = 1;
+	if (workerCount > count)
+		workerCount = count ? count : 1;
+	batchWorker* workers = (batchWorker*)malloc(workerCount * sizeof(batchWorker));
+	struct pollfd* polls = (struct pollfd*)malloc(workerCount * sizeof(struct pollfd));
+	if (!workers || !polls) {
+		free(workers);
+		free(polls);
+		return false;
+	}
+	//a worker dying between dispatch and read must show up as a failed write, not kill the coordinator
+	signal(SIGPIPE, SIG_IGN);
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < workerCount; i++) {
+		workers[i].pid = NO_WORKER;
+		workers[i].fd = -1;
+		workers[i].job = NO_JOB;
+		workers[i].failedDispatches = 0;
+	}
+	uint32_t started = 0;
+	for (uint32_t i = 0; i < workerCount; i++) {
+		if (spawnWorker(workers, i, workerCount, jobs, count))
+			started++;
+		else
+			workers[i].pid = RETIRED;
+	}
+	uint32_t next = 0;
+	while (started) {
+		uint32_t live = 0, alive = 0;
+		for (uint32_t i = 0; i < workerCount; i++) {
+			batchWorker& worker = workers[i];
+			//a slot whose restart fails is given up on, the rest of the batch carries on without it
+			if (worker.pid == NO_WORKER && next < count) {
+				if (spawnWorker(workers, i, workerCount, jobs, count))
+					summary.restarts++;
+				else
+					worker.pid = RETIRED;
+			}
+			//a job that could not be sent never ran, it stays next in line for a fresh worker
+			if (worker.pid >= 0 && worker.job == NO_JOB && next < count) {
+				if (dispatchJob(worker, next, deadline)) {
+					next++;
+					worker.failedDispatches = 0;
+				}
+				else {
+					reapWorker(worker, BATCH_CRASHED, summary, results);
+					if (++worker.failedDispatches >= BATCH_DISPATCH_RETRIES)
+						worker.pid = RETIRED;
+				}
+			}
+			alive += worker.pid != RETIRED;
+			if (worker.pid >= 0 && worker.job != NO_JOB) {
+				polls[live].fd = worker.fd;
+				polls[live].events = POLLIN;
+				polls[live].revents = 0;
+				live++;
+			}
+		}
+		//either everything was dispatched and has come back, or no worker is left to run the rest
+		if (!live && (next == count || !alive))
+			break;
+		int ready = live ? poll(polls, live, pollTimeout(workers, workerCount, deadline)) : 0;
+		for (uint32_t p = 0; ready > 0 && p < live; p++) {
+			if (!polls[p].revents)
+				continue;
+			uint32_t i = 0;
+			while (workers[i].fd != polls[p].fd) i++;
+			batchWorker& worker = workers[i];
+			uint8_t record[BATCH_RECORD];
+			batchResult result;
+			if (readFull(worker.fd, record, sizeof(record))) {
+				unpackBatchResult(record, result);
+				result.job = worker.job;
+				if (result.status > BATCH_CRASHED)
+					result.status = BATCH_FAILED;
+				tallyResult(summary, results, result);
+				worker.job = NO_JOB;
+			}
+			else
+				reapWorker(worker, BATCH_CRASHED, summary, results);
+		}
+		//a hung job is only noticed here, its worker is killed and restarted on the next pass
+		auto now = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; deadline > 0 && i < workerCount; i++) {
+			if (workers[i].pid >= 0 && workers[i].job != NO_JOB && now >= workers[i].deadline) {
+				kill(workers[i].pid, SIGKILL);
+				reapWorker(workers[i], BATCH_TIMEOUT, summary, results);
+			}
+		}
+	}
+	//jobs never handed out because every worker slot was lost
+	for (; started && next < count; next++) {
+		batchResult result;
+		memset(&result, 0, sizeof(result));
+		result.job = next;
+		result.status = BATCH_SKIPPED;
+		tallyResult(summary, results, result);
+	}
+	//closing the sockets is what tells idle workers to exit
+	for (uint32_t i = 0; i < workerCount; i++) {
+		if (workers[i].pid >= 0) {
+			close(workers[i].fd);
+			waitpid(workers[i].pid, nullptr, 0);
+		}
+	}
+	summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	free(workers);
+	free(polls);
+	return started;
+}
+#endif
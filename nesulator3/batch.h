@@ -0,0 +1,68 @@
+#ifndef nesbatch
+#define nesbatch
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+manifest: one job per line, "rom.nes movie.nmv [cycle limit]", blank lines and lines starting with # are skipped.
+paths may not contain spaces, a missing or zero limit runs the whole movie
+
+every finished job is one BATCH_RECORD byte record, sent from a worker to the coordinator and also
+what the optional results file holds, in manifest order. all values little endian
+0x00 uint32 job index in the manifest
+0x04 uint8 BATCH_* status
+0x05 uint8 signal that killed the worker, for BATCH_CRASHED
+0x06 uint16 zero
+0x08 uint32 frames
+0x0C uint64 cycles
+0x14 uint64 ram hash, frame hash, state hash as --replay prints them
+*/
+#define BATCH_RECORD 0x2C
+
+#define BATCH_COMPLETED 0
+#define BATCH_LIMIT 1//stopped by the job's cycle limit
+#define BATCH_FAILED 2//rom or movie could not be loaded
+#define BATCH_CRASHED 3//took its worker down, the worker is restarted and the job not retried
+#define BATCH_SKIPPED 4//never run, every worker was lost and none could be restarted
+#define BATCH_TIMEOUT 5//ran past the job deadline, its worker is killed and restarted and the job not retried
+#define BATCH_STATUSES 6
+
+#define BATCH_DEADLINE 600//default seconds one job may run for, 0 waits forever
+#define BATCH_DISPATCH_RETRIES 3//fresh workers a slot tries in a row before it is given up
+
+struct batchJob {
+	char* rom;
+	char* movie;
+	uint64_t cycleLimit;
+};
+
+struct batchResult {
+	uint32_t job;
+	uint8_t status;
+	uint8_t signal;
+	uint32_t frames;
+	uint64_t cycles;
+	uint64_t ramHash;
+	uint64_t frameHash;
+	uint64_t stateHash;
+};
+
+struct batchSummary {
+	uint32_t jobs;
+	uint32_t counts[BATCH_STATUSES];//per BATCH_* status
+	uint32_t restarts;
+	uint64_t cycles;
+	double seconds;
+};
+
+bool loadManifest(const char* path, batchJob*& jobs, uint32_t& count);
+void destroyManifest(batchJob* jobs, uint32_t count);
+//shards the jobs over worker processes, results is indexed by job and may be null. false only when no
+//worker could be started, otherwise every job has a result even if the workers ran out part way.
+//a job still running after deadline seconds has its worker killed, 0 waits forever
+bool runBatch(const batchJob* jobs, uint32_t count, uint32_t workers, double deadline, batchResult* results, batchSummary&);
+void packBatchResult(const batchResult&, uint8_t* record);
+void unpackBatchResult(const uint8_t* record, batchResult&);
+
+#endif
@@ -0,0 +1,71 @@
+#include "cartridge.h"
+#include "ppu.h"
+#include "cpu.h"
+
+#include <cstdlib>
+#include <stdio.h>
+#include <cstring>
+
+#define INES_HEADER 16
+#define INES_TRAINER 512
+
+bool loadINES(cartridge& cart, const char* path) {
+	cart.prg = nullptr;
+	cart.chr = nullptr;
+	cart.decoded = nullptr;
+	cart.chrTiles = nullptr;
+	FILE* f = fopen(path, "rb");
+	if (!f) {
+		printf("could not open rom %s\n", path);
+		return false;
+	}
+	uint8_t header[INES_HEADER];
+	if (fread(header, 1, INES_HEADER, f) != INES_HEADER || memcmp(header, "NES\x1A", 4) != 0) {
+		printf("%s is not an ines file\n", path);
+		fclose(f);
+		return false;
+	}
+	cart.mapper = (header[6] >> 4) | (header[7] & 0xF0);
+	cart.mirroring = (header[6] & 1) ? MIRROR_VERTICAL : MIRROR_HORIZONTAL;
+	if (cart.mapper != 0) {
+		printf("mapper %d is not supported\n", cart.mapper);
+		fclose(f);
+		return false;
+	}
+	if (header[6] & 0x04)
+		fseek(f, INES_TRAINER, SEEK_CUR);
+	cart.prgSize = header[4] * 0x4000;
+	cart.chrSize = header[5] * 0x2000;
+	cart.chrRam = cart.chrSize == 0;
+	cart.prg = (uint8_t*)malloc(cart.prgSize);
+	cart.chr = (uint8_t*)calloc(cart.chrRam ? 0x2000 : cart.chrSize, 1);
+	cart.decoded = (decodedOp*)calloc(cart.prgSize, sizeof(decodedOp));
+	bool ok = cart.prg && cart.chr && cart.decoded && cart.prgSize > 0
+		&& fread(cart.prg, 1, cart.prgSize, f) == cart.prgSize
+		&& (cart.chrRam || fread(cart.chr, 1, cart.chrSize, f) == cart.chrSize);
+	fclose(f);
+	if (!ok) {
+		printf("%s is truncated\n", path);
+		destroyCartridge(cart);
+		return false;
+	}
+	if (!cart.chrRam && !(cart.chrTiles = createROMTiles(cart.chr))) {
+		destroyCartridge(cart);
+		return false;
+	}
+	if (cart.chrRam)
+		cart.chrSize = 0x2000;
+	cart.refs = 1;
+	return true;
+}
+
+void destroyCartridge(cartridge& cart) {
+	free(cart.prg);
+	free(cart.chr);
+	free(cart.decoded);
+	free(cart.chrTiles);
+	cart.prg = nullptr;
+	cart.chr = nullptr;
+	cart.decoded = nullptr;
+	cart.chrTiles = nullptr;
+}
@@ -0,0 +1,25 @@
+#ifndef nescartridge
+#define nescartridge
+
+#include <stdint.h>
+
+struct chrTileCache;
+struct decodedOp;
+
+struct cartridge {
+	uint8_t* prg;
+	uint32_t prgSize;
+	uint8_t* chr;
+	uint32_t chrSize;
+	bool chrRam;
+	chrTileCache* chrTiles;//decoded chr rom shared by every machine on this cartridge, null for chr ram
+	uint8_t mapper;
+	uint8_t mirroring;
+	decodedOp* decoded;//decode cache for the cpu, one entry per prg byte, filled as code runs or from an analysis sidecar
+	uint32_t refs;//rom is immutable so every fork of a machine shares one cartridge
+};
+
+bool loadINES(cartridge&, const char* path);
+void destroyCartridge(cartridge&);
+
+#endif
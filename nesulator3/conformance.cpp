@@ -0,0 +1,261 @@
+#include "conformance.h"
+#include "nes.h"
+#include "memory.h"
+#include "movie.h"
+
+#include <stdio.h>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+
+//nestest run in automation mode starts here and finishes on the RTS at NESTEST_END
+#define NESTEST_START 0xC000
+#define NESTEST_END 0xC66E
+//generous cap so a broken core spinning somewhere still finishes
+#define FUNCTIONAL_MAX_INSTRUCTIONS 200000000ULL
+
+//either compares against a mapped golden trace or records one, one record per instruction
+struct traceCursor {
+	const uint8_t* golden;
+	size_t goldenSize;
+	void* mapping;
+	uint32_t count;
+	FILE* out;
+	uint64_t index;
+	uint64_t lastCycles;
+	bool mismatch;
+};
+
+void packRecord(const mos6502& _cpu, uint8_t cycles, uint8_t* record) {
+	record[0] = _cpu.PC & 0xFF;
+	record[1] = _cpu.PC >> 8;
+	record[2] = _cpu.A;
+	record[3] = _cpu.X;
+	record[4] = _cpu.Y;
+	record[5] = _cpu.flags;
+	record[6] = _cpu.SP;
+	record[7] = cycles;
+}
+
+void printRecord(const char* label, const uint8_t* r) {
+	printf("  %s %02X%02X  A:%02X X:%02X Y:%02X P:%02X SP:%02X +%u cycles\n", label, r[1], r[0], r[2], r[3], r[4], r[5], r[6], r[7]);
+}
+
+bool openTrace(traceCursor& trace, const char* path, bool record) {
+	memset(&trace, 0, sizeof(trace));
+	if (!path)
+		return true;
+	if (record) {
+		trace.out = fopen(path, "wb");
+		uint8_t header[TRACE_HEADER] = { 'N', 'T', 'R', '1' };
+		return trace.out && fwrite(header, 1, TRACE_HEADER, trace.out) == TRACE_HEADER;
+	}
+	trace.golden = (const uint8_t*)mapFile(path, trace.goldenSize, trace.mapping);
+	if (!trace.golden) {
+		printf("could not map trace %s\n", path);
+		return false;
+	}
+	if (trace.goldenSize < TRACE_HEADER || memcmp(trace.golden, "NTR1", 4) != 0
+		|| (trace.goldenSize - TRACE_HEADER) / TRACE_RECORD < readLE32(trace.golden + 4)) {
+		printf("%s is not a trace file\n", path);
+		unmapFile(trace.golden, trace.goldenSize, trace.mapping);
+		trace.golden = nullptr;
+		return false;
+	}
+	trace.count = readLE32(trace.golden + 4);
+	return true;
+}
+
+//false once the run should stop, either the golden trace is used up or it disagreed
+bool traceStep(traceCursor& trace, const mos6502& _cpu) {
+	uint8_t record[TRACE_RECORD];
+	packRecord(_cpu, (uint8_t)(_cpu.cycles - trace.lastCycles), record);
+	trace.lastCycles = _cpu.cycles;
+	if (trace.out) {
+		fwrite(record, 1, TRACE_RECORD, trace.out);
+		trace.index++;
+		return true;
+	}
+	if (!trace.golden)
+		return true;
+	if (trace.index >= trace.count)
+		return false;
+	const uint8_t* expected = trace.golden + TRACE_HEADER + trace.index * TRACE_RECORD;
+	if (memcmp(expected, record, TRACE_RECORD) != 0) {
+		trace.mismatch = true;
+		printf("trace differs at instruction %llu\n", (unsigned long long)trace.index);
+		printRecord("expected", expected);
+		printRecord("actual  ", record);
+		return false;
+	}
+	trace.index++;
+	return true;
+}
+
+bool closeTrace(traceCursor& trace) {
+	bool ok = true;
+	if (trace.out) {
+		uint8_t count[4] = { (uint8_t)trace.index, (uint8_t)(trace.index >> 8), (uint8_t)(trace.index >> 16), (uint8_t)(trace.index >> 24) };
+		ok = fseek(trace.out, 4, SEEK_SET) == 0 && fwrite(count, 1, 4, trace.out) == 4;
+		fclose(trace.out);
+	}
+	if (trace.golden)
+		unmapFile(trace.golden, trace.goldenSize, trace.mapping);
+	memset(&trace, 0, sizeof(trace));
+	return ok;
+}
+
+//pulls the register columns out of a nestest.log line, the ppu columns are ignored
+bool parseNestestLine(const char* line, uint8_t* record, uint64_t& cycles) {
+	unsigned int pc, a, x, y, p, sp;
+	unsigned long long cyc;
+	const char* regs = strstr(line, "A:");
+	const char* cycText = strstr(line, "CYC:");
+	if (!regs || !cycText || sscanf(line, "%4x", &pc) != 1
+		|| sscanf(regs, "A:%2x X:%2x Y:%2x P:%2x SP:%2x", &a, &x, &y, &p, &sp) != 5
+		|| sscanf(cycText, "CYC:%llu", &cyc) != 1)
+		return false;
+	record[0] = pc & 0xFF;
+	record[1] = pc >> 8;
+	record[2] = a;
+	record[3] = x;
+	record[4] = y;
+	record[5] = p;
+	record[6] = sp;
+	record[7] = (uint8_t)(cyc - cycles);
+	cycles = cyc;
+	return true;
+}
+
+bool convertNestestLog(const char* logPath, const char* tracePath) {
+	FILE* in = fopen(logPath, "r");
+	if (!in) {
+		printf("could not open %s\n", logPath);
+		return false;
+	}
+	FILE* out = fopen(tracePath, "wb");
+	if (!out) {
+		fclose(in);
+		return false;
+	}
+	uint8_t header[TRACE_HEADER] = { 'N', 'T', 'R', '1' };
+	fwrite(header, 1, TRACE_HEADER, out);
+	char line[256];
+	uint32_t count = 0;
+	uint64_t cycles = 0;
+	bool ok = true;
+	while (fgets(line, sizeof(line), in)) {
+		uint8_t record[TRACE_RECORD];
+		if (line[0] == '\r' || line[0] == '\n')
+			continue;
+		if (!parseNestestLine(line, record, cycles)) {
+			printf("%s line %u not understood\n", logPath, count + 1);
+			ok = false;
+			break;
+		}
+		fwrite(record, 1, TRACE_RECORD, out);
+		count++;
+	}
+	uint8_t countBytes[4] = { (uint8_t)count, (uint8_t)(count >> 8), (uint8_t)(count >> 16), (uint8_t)(count >> 24) };
+	ok = ok && fseek(out, 4, SEEK_SET) == 0 && fwrite(countBytes, 1, 4, out) == 4;
+	fclose(out);
+	fclose(in);
+	return ok;
+}
+
+bool runNestest(const char* romPath, const char* tracePath, conformanceResult& result) {
+	traceCursor trace;
+	if (!openTrace(trace, tracePath, false))
+		return false;
+	nes* _nes = (nes*)malloc(sizeof(nes));
+	if (!_nes || !createNES(*_nes, romPath)) {
+		free(_nes);
+		closeTrace(trace);
+		return false;
+	}
+	//automation mode skips the menu and runs every official and stable unofficial opcode test
+	mos6502& _cpu = _nes->mycpu;
+	_cpu.PC = NESTEST_START;
+	memset(&result, 0, sizeof(result));
+	result.traced = trace.golden != nullptr;
+	auto start = std::chrono::steady_clock::now();
+	uint64_t startCycles = _cpu.cycles;
+	while (traceStep(trace, _cpu)) {
+		if (_cpu.PC == NESTEST_END && !trace.golden)
+			break;
+		stepNES(*_nes);
+		result.instructions++;
+	}
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.cycles = _cpu.cycles - startCycles;
+	result.stopPC = _cpu.PC;
+	result.result[0] = _nes->ram.readfun(_nes->ram.data, 0x02);
+	result.result[1] = _nes->ram.readfun(_nes->ram.data, 0x03);
+	result.mismatch = trace.index;
+	result.passed = !trace.mismatch && (!trace.golden || trace.index == trace.count)
+		&& !result.result[0] && !result.result[1];
+	closeTrace(trace);
+	destroyNES(*_nes);
+	free(_nes);
+	return true;
+}
+
+//the functional test wants a flat 64k of ram with the binary image loaded from address 0
+bool runFunctionalTest(const char* binPath, uint16_t successPC, const char* tracePath, bool record, conformanceResult& result) {
+	FILE* f = fopen(binPath, "rb");
+	if (!f) {
+		printf("could not open %s\n", binPath);
+		return false;
+	}
+	uint8_t* image = (uint8_t*)calloc(1, 0x10000);
+	size_t size = image ? fread(image, 1, 0x10000, f) : 0;
+	fclose(f);
+	traceCursor trace;
+	if (!size || !openTrace(trace, tracePath, record)) {
+		free(image);
+		return false;
+	}
+	mos6502 _cpu;
+	device816 low, high;
+	createCpu(_cpu);
+	low.data = nullptr;
+	high.data = nullptr;
+	if (!createRamDevice816(low, 0x8000, 0) || !createRamDevice816(high, 0x8000, 0x8000)
+		|| !addDevice(_cpu, low) || !addDevice(_cpu, high)) {
+		destroyRamDevice816(low);
+		destroyRamDevice816(high);
+		free(_cpu.devices);
+		free(image);
+		closeTrace(trace);
+		return false;
+	}
+	for (uint32_t i = 0; i < 0x10000; i++) {
+		device816& dev = i < 0x8000 ? low : high;
+		dev.writefun(dev.data, (uint16_t)(i & 0x7FFF), image[i]);
+	}
+	free(image);
+	_cpu.PC = FUNCTIONAL_START;
+	memset(&result, 0, sizeof(result));
+	result.traced = trace.golden != nullptr;
+	auto start = std::chrono::steady_clock::now();
+	bool tracing = trace.golden || trace.out;
+	uint16_t lastPC;
+	do {
+		if (tracing && !traceStep(trace, _cpu))
+			break;
+		lastPC = _cpu.PC;
+		stepCpu(_cpu);
+		result.instructions++;
+	//every failure, and the final success, is a branch or jump to itself
+	} while (_cpu.PC != lastPC && result.instructions < FUNCTIONAL_MAX_INSTRUCTIONS);
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.cycles = _cpu.cycles;
+	result.stopPC = _cpu.PC;
+	result.mismatch = trace.index;
+	result.passed = !trace.mismatch && _cpu.PC == successPC;
+	bool ok = closeTrace(trace);
+	destroyRamDevice816(low);
+	destroyRamDevice816(high);
+	free(_cpu.devices);
+	return ok;
+}
@@ -0,0 +1,38 @@
+#ifndef nesconformance
+#define nesconformance
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+golden trace file layout, all values little endian
+0x00 "NTR1"
+0x04 uint32 record count
+0x08 record count * 8 byte records, one per instruction before it executes:
+     uint16 pc, uint8 a, x, y, p, sp, uint8 cycles since the previous record (low byte)
+*/
+#define TRACE_HEADER 8
+#define TRACE_RECORD 8
+
+//klaus dormann's suite loops on itself at this address once every test has passed
+#define FUNCTIONAL_SUCCESS 0x3469
+#define FUNCTIONAL_START 0x0400
+//where --conformance looks when no directory is given, relative to the project directory
+#define CONFORMANCE_DIR "tests/conformance"
+
+struct conformanceResult {
+	uint64_t instructions;
+	uint64_t cycles;
+	double seconds;//host time for the run, trace comparison excluded
+	bool passed;
+	bool traced;//a golden trace was compared
+	uint64_t mismatch;//record index of the first difference, only meaningful when traced and not passed
+	uint16_t stopPC;//where the program ended up, the trap address for the functional test
+	uint8_t result[2];//nestest error codes left at $02 and $03
+};
+
+bool convertNestestLog(const char* logPath, const char* tracePath);
+bool runNestest(const char* romPath, const char* tracePath, conformanceResult&);
+bool runFunctionalTest(const char* binPath, uint16_t successPC, const char* tracePath, bool record, conformanceResult&);
+
+#endif
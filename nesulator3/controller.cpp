@@ -0,0 +1,46 @@
+#include "controller.h"
+
+uint8_t controllerRead(void* mypads, uint16_t address) {
+	controllers* pads = (controllers*)mypads;
+	int port = address & 1;
+	if (pads->strobe)
+		return 0x40 | (pads->buttons[port] & 1);
+	uint8_t bit = pads->shift[port] & 1;
+	//official pads report 1 once all eight buttons have been shifted out
+	pads->shift[port] = (pads->shift[port] >> 1) | 0x80;
+	return 0x40 | bit;
+}
+
+void controllerWrite(void* mypads, uint16_t address, uint8_t val) {
+	controllers* pads = (controllers*)mypads;
+	//$4017 writes belong to the apu frame counter
+	if (address != 0)
+		return;
+	pads->strobe = val & 1;
+	if (pads->strobe) {
+		pads->shift[0] = pads->buttons[0];
+		pads->shift[1] = pads->buttons[1];
+	}
+}
+
+void createControllers(controllers& pads) {
+	pads.buttons[0] = 0;
+	pads.buttons[1] = 0;
+	pads.shift[0] = 0;
+	pads.shift[1] = 0;
+	pads.strobe = false;
+}
+
+void createControllerDevice(device816& dev, controllers& pads) {
+	dev.data = &pads;
+	dev.start = 0x4016;
+	dev.length = 2;
+	dev.readfun = &(controllerRead);
+	dev.writefun = &(controllerWrite);
+}
+
+void setButtons(controllers& pads, int port, uint8_t buttons) {
+	pads.buttons[port & 1] = buttons;
+	if (pads.strobe)
+		pads.shift[port & 1] = buttons;
+}
@@ -0,0 +1,26 @@
+#ifndef nescontroller
+#define nescontroller
+
+#include "emulatorGlue.h"
+
+//button bits in the order the shift register reports them
+#define BUTTON_A 0x01
+#define BUTTON_B 0x02
+#define BUTTON_SELECT 0x04
+#define BUTTON_START 0x08
+#define BUTTON_UP 0x10
+#define BUTTON_DOWN 0x20
+#define BUTTON_LEFT 0x40
+#define BUTTON_RIGHT 0x80
+
+struct controllers {
+	uint8_t buttons[2];
+	uint8_t shift[2];
+	bool strobe;
+};
+
+void createControllers(controllers&);
+void createControllerDevice(device816&, controllers&);
+void setButtons(controllers&, int port, uint8_t buttons);
+
+#endif
@@ -11,14 +11,22 @@
 void createCpu(mos6502& _cpu) {
 	_cpu.A = 0;
 	_cpu.PC = 0x8000;
-	_cpu.SP = 0xFF;
-	_cpu.flags = 0;
+	//power on state, the reset sequence then takes SP to $FD and sets I
+	_cpu.SP = 0x00;
+	_cpu.flags = 0x20;
 	_cpu.X = 0;
 	_cpu.Y = 0;
 	_cpu.interupts = 0;
 	_cpu.devices = nullptr;
 	_cpu.deviceCount = 0;
-	printf("created cpu\n");
+	_cpu.cycles = 0;
+	_cpu.trapdata = nullptr;
+	_cpu.decoded = nullptr;
+	_cpu.decodedMask = 0;
+	_cpu.current = nullptr;
+	for (int i = 0; i < 256; i++) {
+		untrapPage(_cpu, (uint8_t)i);
+	}
 }
 
 bool addDevice(mos6502& _cpu, device816& dev) {
@@ -33,6 +41,8 @@ bool addDevice(mos6502& _cpu, device816& dev) {
 	}
 	if (newdevs == nullptr) {
 		free(_cpu.devices);
+		_cpu.devices = nullptr;
+		_cpu.deviceCount = 0;
 		return false;
 	}
 	else {
@@ -46,7 +56,7 @@ bool addDevice(mos6502& _cpu, device816& dev) {
 ###################################--- BASIC READ/WRITE ---#######################################
 */
 
-uint8_t basicRead(mos6502& _cpu, uint16_t address) {
+uint8_t deviceRead(mos6502& _cpu, uint16_t address) {
 	for (size_t i = 0; i < _cpu.deviceCount; i++) {
 		device816& dev = _cpu.devices[i];
 		if (dev.start <= address && dev.start + dev.length > address) {
@@ -56,7 +66,7 @@ uint8_t basicRead(mos6502& _cpu, uint16_t address) {
 	return 0;
 }
 
-void basicWrite(mos6502& _cpu, uint16_t address, uint8_t value) {
+void deviceWrite(mos6502& _cpu, uint16_t address, uint8_t value) {
 	for (size_t i = 0; i < _cpu.deviceCount; i++) {
 		device816& dev = _cpu.devices[i];
 		if (dev.start <= address && dev.start + dev.length > address) {
@@ -65,6 +75,31 @@ void basicWrite(mos6502& _cpu, uint16_t address, uint8_t value) {
 	}
 }
 
+void trapPage(mos6502& _cpu, uint8_t page, busReadHandler readfun, busWriteHandler writefun) {
+	_cpu.pageRead[page] = readfun;
+	_cpu.pageWrite[page] = writefun;
+}
+
+void untrapPage(mos6502& _cpu, uint8_t page) {
+	_cpu.pageRead[page] = &(deviceRead);
+	_cpu.pageWrite[page] = &(deviceWrite);
+}
+
+inline
+uint8_t basicRead(mos6502& _cpu, uint16_t address) {
+	return _cpu.pageRead[address >> 8](_cpu, address);
+}
+
+inline
+void basicWrite(mos6502& _cpu, uint16_t address, uint8_t value) {
+	_cpu.pageWrite[address >> 8](_cpu, address, value);
+}
+
+//device style read of the whole cpu bus, for units like the apu dmc that fetch their own data
+uint8_t busRead816(void* mycpu, uint16_t address) {
+	return basicRead(*(mos6502*)mycpu, address);
+}
+
 void push(mos6502& _cpu, uint8_t value) {
 	basicWrite(_cpu, 0x100 + _cpu.SP--, value);
 }
@@ -121,49 +156,67 @@ void donzc(mos6502& _cpu, uint16_t val) {
 	setFlag(_cpu, FLAGS.C, val & 0x100);
 }
 
+//binary add with carry in and out, the 2a03 has no decimal mode so D is ignored
+inline
+void addWithCarry(mos6502& _cpu, uint8_t v) {
+	uint8_t mayover = ~(v^_cpu.A);
+	uint16_t total = v + _cpu.A + (testFlag(_cpu, FLAGS.C)?1:0);
+	_cpu.A = (uint8_t)total;
+	donzc(_cpu, total);
+	setFlag(_cpu, FLAGS.V, mayover&(v^_cpu.A)&0x80);
+}
+
+//carry is set when there is no borrow
+inline
+void compare(mos6502& _cpu, uint8_t reg, uint8_t v) {
+	donzc(_cpu, reg + (uint8_t)~v + 1);
+}
+
 /*
 ###################################--- INTERUPT FUNCTIONS ---#######################################
 */
 
-#define IRQ_VEC 0xFFFE
-#define NMI_VEC 0xFFFA
-#define BRK_VEC 0xFFFE
-#define RST_VEC 0xFFFC
-
-void triggerNMI(mos6502& _cpu) {
-	_cpu.PC += 2;
+//hardware interrupts push the address of the next instruction, then the flags with B clear
+void interrupt(mos6502& _cpu, uint16_t vector) {
 	push(_cpu, _cpu.PC >> 8);
-	push(_cpu, _cpu.PC & 0xf);
-	push(_cpu, _cpu.flags);
+	push(_cpu, _cpu.PC & 0xFF);
+	push(_cpu, (_cpu.flags & ~FLAGS.B) | 0x20);
 	setFlag(_cpu, FLAGS.I);
-	_cpu.PC = basicRead(_cpu, NMI_VEC);
-	_cpu.PC |= basicRead(_cpu, NMI_VEC + 1) << 8;
+	_cpu.PC = basicRead(_cpu, vector);
+	_cpu.PC |= basicRead(_cpu, vector + 1) << 8;
+}
+
+void triggerNMI(mos6502& _cpu) {
+	interrupt(_cpu, NMI_VEC);
 }
 void triggerRST(mos6502& _cpu) {
-	_cpu.PC += 2;
-	push(_cpu, _cpu.PC >> 8);
-	push(_cpu, _cpu.PC & 0xf);
-	push(_cpu, _cpu.flags);
+	//reset runs the interrupt sequence with the stack writes suppressed
+	_cpu.SP -= 3;
 	setFlag(_cpu, FLAGS.I);
 	_cpu.PC = basicRead(_cpu, RST_VEC);
 	_cpu.PC |= basicRead(_cpu, RST_VEC + 1) << 8;
 }
 void triggerIRQ(mos6502& _cpu) {
-	_cpu.PC += 2;
-	push(_cpu, _cpu.PC >> 8);
-	push(_cpu, _cpu.PC & 0xf);
-	push(_cpu, _cpu.flags);
-	setFlag(_cpu, FLAGS.I);
-	_cpu.PC = basicRead(_cpu, IRQ_VEC);
-	_cpu.PC |= basicRead(_cpu, IRQ_VEC + 1) << 8;
+	interrupt(_cpu, IRQ_VEC);
 }
 
 /*
 ###################################--- ADDRESS MODES ---#######################################
 */
 
+//the bytes after the opcode, taken from the cache entry when the instruction is run from the decode cache
+inline
+uint8_t operandByte(mos6502& _cpu) {
+	return _cpu.current ? (uint8_t)_cpu.current->operand : basicRead(_cpu, _cpu.PC);
+}
+
+inline
+uint16_t operandWord(mos6502& _cpu) {
+	return _cpu.current ? _cpu.current->operand : basicRead(_cpu, _cpu.PC) | (basicRead(_cpu, _cpu.PC + 1) << 8);
+}
+
 uint16_t abs(mos6502& _cpu) {
-	uint16_t address = basicRead(_cpu, _cpu.PC) | (basicRead(_cpu, _cpu.PC+1)<<8);
+	uint16_t address = operandWord(_cpu);
 	_cpu.PC += 2;
 	return address;
 
@@ -178,99 +231,150 @@ void accWrite(mos6502& _cpu, uint8_t val) {
 }
 
 uint16_t absx(mos6502& _cpu) {
-	uint16_t ret = (basicRead(_cpu, _cpu.PC) | (basicRead(_cpu, _cpu.PC+1)<<8)) + _cpu.X;
+	uint16_t ret = operandWord(_cpu) + _cpu.X;
 	_cpu.PC += 2;
 	return ret;
 }
 
 uint16_t absy(mos6502& _cpu) {
-	uint16_t ret = (basicRead(_cpu, _cpu.PC) | (basicRead(_cpu, _cpu.PC+1)<<8)) + _cpu.Y;
+	uint16_t ret = operandWord(_cpu) + _cpu.Y;
 	_cpu.PC += 2;
 	return ret;
 }
 
+//indexed reads take a cycle longer when the index carries into the high byte, writes always pay it
+inline
+uint16_t pagePenalty(mos6502& _cpu, uint16_t base, uint8_t index) {
+	uint16_t address = base + index;
+	if ((address ^ base) & 0xFF00) _cpu.cycles++;
+	return address;
+}
+
+uint16_t absxp(mos6502& _cpu) {
+	uint16_t base = operandWord(_cpu);
+	_cpu.PC += 2;
+	return pagePenalty(_cpu, base, _cpu.X);
+}
+
+uint16_t absyp(mos6502& _cpu) {
+	uint16_t base = operandWord(_cpu);
+	_cpu.PC += 2;
+	return pagePenalty(_cpu, base, _cpu.Y);
+}
+
 uint16_t imm(mos6502& _cpu) {
 	return _cpu.PC++;
 }
 
 uint16_t ind(mos6502& _cpu) {
-	uint16_t address =  (basicRead(_cpu, _cpu.PC) | (basicRead(_cpu, _cpu.PC+1)<<8));
-	uint16_t v = basicRead(_cpu, address) | (basicRead(_cpu, address+1)<<8);
+	uint16_t address = operandWord(_cpu);
+	//the pointer high byte is fetched without carrying into the page, JMP ($10FF) reads $10FF and $1000
+	uint16_t v = basicRead(_cpu, address) | (basicRead(_cpu, (address & 0xFF00) | ((address + 1) & 0xFF))<<8);
 	_cpu.PC += 2;
 	return v;
 }
 
+//pointers for the indirect modes live in zero page and wrap within it
+inline
+uint16_t zpgPointer(mos6502& _cpu, uint8_t address) {
+	return basicRead(_cpu, address) | (basicRead(_cpu, (uint8_t)(address + 1))<<8);
+}
+
 uint16_t xind(mos6502& _cpu) {
-	uint16_t address =  (basicRead(_cpu, _cpu.PC) | (basicRead(_cpu, _cpu.PC+1)<<8)) + _cpu.X;
-	uint16_t v = basicRead(_cpu, address) | (basicRead(_cpu, address+1)<<8);
-	_cpu.PC += 2;
-	return v;
+	uint8_t address = operandByte(_cpu) + _cpu.X;
+	_cpu.PC += 1;
+	return zpgPointer(_cpu, address);
 }
 
 uint16_t indy(mos6502& _cpu) {
-	uint16_t address =  (basicRead(_cpu, _cpu.PC) | (basicRead(_cpu, _cpu.PC+1)<<8));
-	uint16_t v = (uint8_t)(basicRead(_cpu, address) | (basicRead(_cpu, address+1)<<8) + _cpu.Y);
-	_cpu.PC += 2;
+	uint16_t v = zpgPointer(_cpu, operandByte(_cpu)) + _cpu.Y;
+	_cpu.PC += 1;
 	return v;
 }
 
+uint16_t indyp(mos6502& _cpu) {
+	uint16_t base = zpgPointer(_cpu, operandByte(_cpu));
+	_cpu.PC += 1;
+	return pagePenalty(_cpu, base, _cpu.Y);
+}
+
 uint16_t inline zpg(mos6502& _cpu) {
-	uint16_t val = basicRead(_cpu, _cpu.PC);
+	uint16_t val = operandByte(_cpu);
 	_cpu.PC += 1;
 	return val;
 }
 
 uint16_t inline zpgx(mos6502& _cpu) {
-	uint16_t val = (uint8_t)(basicRead(_cpu, _cpu.PC)+_cpu.X);
+	uint16_t val = (uint8_t)(operandByte(_cpu)+_cpu.X);
 	_cpu.PC += 1;
 	return val;
 }
 
 uint16_t inline zpgy(mos6502& _cpu) {
-	uint16_t val =  (uint8_t)(basicRead(_cpu, _cpu.PC)+_cpu.Y);
+	uint16_t val =  (uint8_t)(operandByte(_cpu)+_cpu.Y);
 	_cpu.PC += 1;
 	return val;
 }
 
 uint16_t inline rel(mos6502& _cpu) {
-	return (int8_t)basicRead(_cpu, _cpu.PC++) + _cpu.PC;
+	int8_t offset = (int8_t)operandByte(_cpu);
+	_cpu.PC++;
+	return _cpu.PC + offset;
+}
+
+//taken branches cost a cycle, and another when they land on a different page
+inline
+void branch(mos6502& _cpu, bool taken, uint16_t target) {
+	if (!taken)
+		return;
+	_cpu.cycles += ((target ^ _cpu.PC) & 0xFF00) ? 2 : 1;
+	_cpu.PC = target;
+}
+
+//the value an instruction works on, immediates come straight from the cache entry
+template<uint16_t(addMode)(mos6502&)>
+inline
+uint8_t readValue(mos6502& _cpu) {
+	if (addMode == &imm && _cpu.current) {
+		_cpu.PC++;
+		return (uint8_t)_cpu.current->operand;
+	}
+	return basicRead(_cpu, addMode(_cpu));
 }
 
 /*
 ###################################--- INSTRUCTIONS ---#######################################
 */
 
+//undefined opcodes (clockcycles 0) are treated as 2 cycle nops so headless runs never stall
 template <int clockcycles>
-int nop(mos6502& _cpu) {
-	if (clockcycles == 0) {
-		printf("nop or undefined at %X\n", _cpu.PC);
-		getchar();
-	}
-	return clockcycles;
+int nop(mos6502&) {
+	return clockcycles ? clockcycles : 2;
 }
 
 template <int clockcycles>
 int BRK(mos6502& _cpu) {
-	_cpu.PC += 2;
+	//software interrupt, the byte after the opcode is padding and skipped on return
+	_cpu.PC += 1;
 	push(_cpu, _cpu.PC >> 8);
-	push(_cpu, _cpu.PC & 0xf);
-	setFlag(_cpu, FLAGS.B);
-	push(_cpu, _cpu.flags);
+	push(_cpu, _cpu.PC & 0xFF);
+	push(_cpu, _cpu.flags | FLAGS.B | 0x20);
 	setFlag(_cpu, FLAGS.I);
+	_cpu.PC = basicRead(_cpu, IRQ_VEC);
+	_cpu.PC |= basicRead(_cpu, IRQ_VEC + 1) << 8;
 	return clockcycles;
-	//exit(1);
-}//7 cycles ----------------IMPLEMENT THIS WHEN I KNOW WHAT IT DOES---------------------------
+}//7 cycles
 
 template <int clockcycles>
 int PHP(mos6502& _cpu) {
-	push(_cpu, _cpu.flags);
+	push(_cpu, _cpu.flags | FLAGS.B | 0x20);
 	return clockcycles;
 }//3 cycles
 
 template<uint16_t(readPrim)(mos6502&), int clockcycles>
 int BPL(mos6502& _cpu) {
 	uint16_t loc = readPrim(_cpu);
-	if (!testFlag(_cpu, FLAGS.N)) _cpu.PC = loc;
+	branch(_cpu, !testFlag(_cpu, FLAGS.N), loc);
 	return clockcycles;
 }//2+(1 or 2 - depending on if in block or not) cycles
 
@@ -282,7 +386,7 @@ int CLC(mos6502& _cpu) {
 
 template<uint16_t(addMode)(mos6502&), int clockcycles>
 int ORA(mos6502& _cpu) {
-	uint8_t v = _cpu.A | basicRead(_cpu, addMode(_cpu));
+	uint8_t v = _cpu.A | readValue<addMode>(_cpu);
 	_cpu.A = v;
 	donz(_cpu, v);
 	return clockcycles;
@@ -307,32 +411,35 @@ int ASLA(mos6502& _cpu) {
 
 template<uint16_t(readPrim)(mos6502&), int clockcycles>
 int JSR(mos6502& _cpu) {
-	uint16_t v = readPrim(_cpu);//not sure if this gets a 16 bit value llhh
-	_cpu.PC += 2;
-	push(_cpu, _cpu.PC & 0xf);
-	push(_cpu, _cpu.PC >> 8);
+	uint16_t v = readPrim(_cpu);
+	//the return address pushed is the last byte of the JSR, RTS adds the one back
+	uint16_t last = _cpu.PC - 1;
+	push(_cpu, last >> 8);
+	push(_cpu, last & 0xFF);
 	_cpu.PC = v;
 	return clockcycles;
 }// 6 cycles
 
 template <int clockcycles>
 int PLP(mos6502& _cpu) {
-	_cpu.flags = pop(_cpu);
+	//B only exists on the stack copy and bit 5 always reads set
+	_cpu.flags = (pop(_cpu) & ~FLAGS.B) | 0x20;
 	return clockcycles;
 }//4 cycles
 
 template<uint16_t(addMode)(mos6502&), int clockcycles>
 int BIT(mos6502& _cpu) {
-	uint8_t res = _cpu.A & basicRead(_cpu, addMode(_cpu));
-	donz(_cpu, res);
-	setFlag(_cpu, FLAGS.V, res&0x40);
+	uint8_t v = readValue<addMode>(_cpu);
+	setFlag(_cpu, FLAGS.Z, !(_cpu.A & v));
+	setFlag(_cpu, FLAGS.N, v & 0x80);
+	setFlag(_cpu, FLAGS.V, v & 0x40);
 	return clockcycles;
 }//4 cycles
 
 template <uint16_t(ReadPrim)(mos6502&),int clockcycles>
 int BMI(mos6502& _cpu) {
 	uint16_t add = ReadPrim(_cpu);
-	if (testFlag(_cpu, FLAGS.N)) _cpu.PC = add;
+	branch(_cpu, testFlag(_cpu, FLAGS.N), add);
 	return clockcycles;
 }
 
@@ -344,7 +451,7 @@ int SEC(mos6502& _cpu) {
 
 template<uint16_t(addMode)(mos6502&), int clockcycles>
 int AND(mos6502& _cpu) {
-	uint8_t v = _cpu.A & basicRead(_cpu, addMode(_cpu));
+	uint8_t v = _cpu.A & readValue<addMode>(_cpu);
 	_cpu.A = v;
 	donz(_cpu, v);
 	return clockcycles;
@@ -353,27 +460,27 @@ int AND(mos6502& _cpu) {
 template<uint16_t(addMode)(mos6502&), int clockcycles>
 int ROL(mos6502& _cpu) {
 	uint16_t address = addMode(_cpu);
-	uint8_t v = basicRead(_cpu, address);
-	v = (v << 1) | (v >> 7);
+	uint8_t old = basicRead(_cpu, address);
+	uint8_t v = (old << 1) | (testFlag(_cpu, FLAGS.C) ? 1 : 0);
 	basicWrite(_cpu, address, v);
 	donz(_cpu, v);
-	setFlag(_cpu, FLAGS.C, v & 1);
+	setFlag(_cpu, FLAGS.C, old & 0x80);
 	return clockcycles;
 }
 template<int clockcycles>
 int ROLA(mos6502& _cpu) {
-	uint8_t v = _cpu.A;
-	v = (v << 1) | (v >> 7);
+	uint8_t old = _cpu.A;
+	uint8_t v = (old << 1) | (testFlag(_cpu, FLAGS.C) ? 1 : 0);
 	_cpu.A = v;
 	donz(_cpu, v);
-	setFlag(_cpu, FLAGS.C, v & 1);
+	setFlag(_cpu, FLAGS.C, old & 0x80);
 	return clockcycles;
 }
 template <int clockcycles>
 int RTI(mos6502& _cpu) {
-	//printf("rti###################################################");
-	_cpu.flags = pop(_cpu);
-	_cpu.PC = (pop(_cpu) << 8) | pop(_cpu);
+	_cpu.flags = (pop(_cpu) & ~FLAGS.B) | 0x20;
+	_cpu.PC = pop(_cpu);
+	_cpu.PC |= pop(_cpu) << 8;
 	return clockcycles;
 }
 
@@ -392,7 +499,7 @@ int JMP(mos6502& _cpu) {
 template<uint16_t(readPrim)(mos6502&), int clockcycles>
 int BVC(mos6502& _cpu) {
 	uint16_t add = readPrim(_cpu);
-	if (!testFlag(_cpu, FLAGS.V)) _cpu.PC = add;
+	branch(_cpu, !testFlag(_cpu, FLAGS.V), add);
 	return clockcycles;
 }
 
@@ -419,52 +526,47 @@ int LSRA(mos6502& _cpu) {
 
 template <int clockcycles>
 int CLI(mos6502& _cpu) {
-	printf("cli ");
 	unsetFlag(_cpu, FLAGS.I);
 	return clockcycles;
 }
 
 template<uint16_t(addMode)(mos6502&), int clockcycles>
 int EOR(mos6502& _cpu) {
-	_cpu.A ^= basicRead(_cpu, addMode(_cpu));
+	_cpu.A ^= readValue<addMode>(_cpu);
 	donz(_cpu, _cpu.A);
 	return clockcycles;
 }
 
 template <int clockcycles>
 int RTS(mos6502& _cpu) {
-	_cpu.PC = (pop(_cpu)<<8) + pop(_cpu);
+	_cpu.PC = pop(_cpu);
+	_cpu.PC |= pop(_cpu) << 8;
+	_cpu.PC++;
 	return clockcycles;
 }
 
 template<uint16_t(addMode)(mos6502&), int clockcycles>
 int ADC(mos6502& _cpu) {
-	uint8_t v = basicRead(_cpu, addMode(_cpu));
-	uint8_t mayover = ~(v^_cpu.A);
-	uint16_t total = v + _cpu.A + (testFlag(_cpu, FLAGS.C)?1:0);
-	_cpu.A = (uint8_t)total;
-	donzc(_cpu, total);
-	setFlag(_cpu, FLAGS.V, mayover&(v^_cpu.A)&0x80);
-	//printf("%ddi", ((total >> 8) & 1));
+	addWithCarry(_cpu, readValue<addMode>(_cpu));
 	return clockcycles;
 }
 template<uint16_t(addMode)(mos6502&), int clockcycles>
 int ROR(mos6502& _cpu) {
 	uint16_t address = addMode(_cpu);
-	uint8_t v = basicRead(_cpu, address);
-	v = (v >> 1) | (v << 7);
+	uint8_t old = basicRead(_cpu, address);
+	uint8_t v = (old >> 1) | (testFlag(_cpu, FLAGS.C) ? 0x80 : 0);
 	basicWrite(_cpu, address, v);
 	donz(_cpu, v);
-	setFlag(_cpu, FLAGS.C, v & 0x80);
+	setFlag(_cpu, FLAGS.C, old & 1);
 	return clockcycles;
 }
 template<int clockcycles>
 int RORA(mos6502& _cpu) {
-	uint8_t v = _cpu.A;
-	v = (v >> 1) | (v << 7);
+	uint8_t old = _cpu.A;
+	uint8_t v = (old >> 1) | (testFlag(_cpu, FLAGS.C) ? 0x80 : 0);
 	_cpu.A = v;
 	donz(_cpu, v);
-	setFlag(_cpu, FLAGS.C, v & 0x80);
+	setFlag(_cpu, FLAGS.C, old & 1);
 	return clockcycles;
 }
 template <int clockcycles>
@@ -476,8 +578,7 @@ int PLA(mos6502& _cpu) {
 template<uint16_t(readPrim)(mos6502&), int clockcycles>
 int BVS(mos6502& _cpu) {
 	uint16_t add = readPrim(_cpu);
-	if (testFlag(_cpu, FLAGS.V)) _cpu.PC = add;
-
+	branch(_cpu, testFlag(_cpu, FLAGS.V), add);
 	return clockcycles;
 }
 template <int clockcycles>
@@ -526,24 +627,24 @@ int TXS(mos6502& _cpu) {
 template<uint16_t(readPrim)(mos6502&), int clockcycles>
 int BCC(mos6502& _cpu) {
 	uint16_t add = readPrim(_cpu);
-	if (!testFlag(_cpu, FLAGS.C)) { _cpu.PC = add; }
+	branch(_cpu, !testFlag(_cpu, FLAGS.C), add);
 	return clockcycles;
 }
 template<uint16_t(addMode)(mos6502&), int clockcycles>
 int LDY(mos6502& _cpu) {
-	_cpu.Y = basicRead(_cpu, addMode(_cpu));
+	_cpu.Y = readValue<addMode>(_cpu);
 	donz(_cpu, _cpu.Y);
 	return clockcycles;
 }
 template<uint16_t(addMode)(mos6502&), int clockcycles>
 int LDA(mos6502& _cpu) {
-	_cpu.A = basicRead(_cpu, addMode(_cpu));
+	_cpu.A = readValue<addMode>(_cpu);
 	donz(_cpu, _cpu.A);
 	return clockcycles;
 }
 template<uint16_t(addMode)(mos6502&), int clockcycles>
 int LDX(mos6502& _cpu) {
-	_cpu.X = basicRead(_cpu, addMode(_cpu));
+	_cpu.X = readValue<addMode>(_cpu);
 	donz(_cpu, _cpu.X);
 	return clockcycles;
 }
@@ -573,25 +674,23 @@ int TSX(mos6502& _cpu) {
 template<uint16_t(readPrim)(mos6502&), int clockcycles>
 int BCS(mos6502& _cpu) {
 	uint16_t add = readPrim(_cpu);
-	if (testFlag(_cpu, FLAGS.C)) { _cpu.PC = add; }
+	branch(_cpu, testFlag(_cpu, FLAGS.C), add);
 	return clockcycles;
 }
 template<uint16_t(addMode)(mos6502&), int clockcycles>
 int CMP(mos6502& _cpu) {
-	uint16_t v = _cpu.A - basicRead(_cpu, addMode(_cpu));
-	donzc(_cpu, v);
+	compare(_cpu, _cpu.A, readValue<addMode>(_cpu));
 	return clockcycles;
 }
 template<uint16_t(readPrim)(mos6502&), int clockcycles>
 int BNE(mos6502& _cpu) {
 	uint16_t add = readPrim(_cpu);
-	if (!testFlag(_cpu, FLAGS.Z)) { _cpu.PC = add; }
+	branch(_cpu, !testFlag(_cpu, FLAGS.Z), add);
 	return clockcycles;
 }
 template<uint16_t(addMode)(mos6502&), int clockcycles>
 int CPY(mos6502& _cpu) {
-	uint16_t v = _cpu.Y - basicRead(_cpu, addMode(_cpu));
-	donzc(_cpu, v);
+	compare(_cpu, _cpu.Y, readValue<addMode>(_cpu));
 	return clockcycles;
 }
 template<uint16_t(addMode)(mos6502&), int clockcycles>
@@ -621,30 +720,27 @@ int CLD(mos6502& _cpu) {
 }
 template<uint16_t(addMode)(mos6502&), int clockcycles>
 int CPX(mos6502& _cpu) {
-	uint16_t v = _cpu.X - basicRead(_cpu, addMode(_cpu));
-	donzc(_cpu, v);
+	compare(_cpu, _cpu.X, readValue<addMode>(_cpu));
 	return clockcycles;
 }
 template<uint16_t(addMode)(mos6502&), int clockcycles>
 int SBC(mos6502& _cpu) {
-	uint8_t v = ~basicRead(_cpu, addMode(_cpu));
-	uint8_t mayover = ~(v^_cpu.A);
-	uint16_t val = _cpu.A + v + testFlag(_cpu, FLAGS.C)?1:0;
-	_cpu.A = (uint8_t)val;
-	donzc(_cpu, val);
-	setFlag(_cpu, FLAGS.V, mayover&(v^_cpu.A)&0x80);
+	//subtraction is addition of the ones complement, carry acting as not borrow
+	addWithCarry(_cpu, ~readValue<addMode>(_cpu));
 	return clockcycles;
 }
 template<uint16_t(addMode)(mos6502&), int clockcycles>
 int INC(mos6502& _cpu) {
 	uint16_t address = addMode(_cpu);
-	basicWrite(_cpu, address, basicRead(_cpu, address)+1);
+	uint8_t val = basicRead(_cpu, address) + 1;
+	basicWrite(_cpu, address, val);
+	donz(_cpu, val);
 	return clockcycles;
 }
 template<uint16_t(readPrim)(mos6502&), int clockcycles>
 int BEQ(mos6502& _cpu) {
 	uint16_t add = readPrim(_cpu);
-	if (FLAGS.Z == 1) { _cpu.PC = add; }
+	branch(_cpu, testFlag(_cpu, FLAGS.Z), add);
 	return clockcycles;
 }
 template <int clockcycles>
@@ -659,29 +755,244 @@ int SED(mos6502& _cpu) {
 	return clockcycles;
 }
 
+/*
+###################################--- UNOFFICIAL ---#######################################
+*/
+
+//the stable undocumented nmos opcodes, mostly a read modify write fused with an alu op
+
+template<uint16_t(addMode)(mos6502&), int clockcycles>
+int NOP(mos6502& _cpu) {
+	//the operand is still read, which matters when it is a register with read side effects
+	readValue<addMode>(_cpu);
+	return clockcycles;
+}
+template<uint16_t(addMode)(mos6502&), int clockcycles>
+int LAX(mos6502& _cpu) {
+	_cpu.A = _cpu.X = readValue<addMode>(_cpu);
+	donz(_cpu, _cpu.A);
+	return clockcycles;
+}
+template<uint16_t(addMode)(mos6502&), int clockcycles>
+int SAX(mos6502& _cpu) {
+	basicWrite(_cpu, addMode(_cpu), _cpu.A & _cpu.X);
+	return clockcycles;
+}
+template<uint16_t(addMode)(mos6502&), int clockcycles>
+int SLO(mos6502& _cpu) {
+	uint16_t address = addMode(_cpu);
+	uint8_t old = basicRead(_cpu, address);
+	uint8_t v = old << 1;
+	basicWrite(_cpu, address, v);
+	_cpu.A |= v;
+	donz(_cpu, _cpu.A);
+	setFlag(_cpu, FLAGS.C, old & 0x80);
+	return clockcycles;
+}
+template<uint16_t(addMode)(mos6502&), int clockcycles>
+int RLA(mos6502& _cpu) {
+	uint16_t address = addMode(_cpu);
+	uint8_t old = basicRead(_cpu, address);
+	uint8_t v = (old << 1) | (testFlag(_cpu, FLAGS.C) ? 1 : 0);
+	basicWrite(_cpu, address, v);
+	_cpu.A &= v;
+	donz(_cpu, _cpu.A);
+	setFlag(_cpu, FLAGS.C, old & 0x80);
+	return clockcycles;
+}
+template<uint16_t(addMode)(mos6502&), int clockcycles>
+int SRE(mos6502& _cpu) {
+	uint16_t address = addMode(_cpu);
+	uint8_t old = basicRead(_cpu, address);
+	uint8_t v = old >> 1;
+	basicWrite(_cpu, address, v);
+	_cpu.A ^= v;
+	donz(_cpu, _cpu.A);
+	setFlag(_cpu, FLAGS.C, old & 1);
+	return clockcycles;
+}
+template<uint16_t(addMode)(mos6502&), int clockcycles>
+int RRA(mos6502& _cpu) {
+	uint16_t address = addMode(_cpu);
+	uint8_t old = basicRead(_cpu, address);
+	uint8_t v = (old >> 1) | (testFlag(_cpu, FLAGS.C) ? 0x80 : 0);
+	basicWrite(_cpu, address, v);
+	setFlag(_cpu, FLAGS.C, old & 1);
+	addWithCarry(_cpu, v);
+	return clockcycles;
+}
+template<uint16_t(addMode)(mos6502&), int clockcycles>
+int DCP(mos6502& _cpu) {
+	uint16_t address = addMode(_cpu);
+	uint8_t v = basicRead(_cpu, address) - 1;
+	basicWrite(_cpu, address, v);
+	compare(_cpu, _cpu.A, v);
+	return clockcycles;
+}
+template<uint16_t(addMode)(mos6502&), int clockcycles>
+int ISB(mos6502& _cpu) {
+	uint16_t address = addMode(_cpu);
+	uint8_t v = basicRead(_cpu, address) + 1;
+	basicWrite(_cpu, address, v);
+	addWithCarry(_cpu, ~v);
+	return clockcycles;
+}
+
+//(handler, mnemonic, addressing mode) for every opcode in order, cpuopmap and cpuopinfo are both expanded from this list
+#define CPU_OPCODES(OP) \
+	/*0*/ OP((BRK<7>), "BRK", AM_IMP)        OP((ORA<xind, 6>), "ORA", AM_XIN)  OP((nop<0>), "???", AM_IMP)        OP((SLO<xind, 8>), "SLO", AM_XIN)  OP((NOP<zpg, 3>), "NOP", AM_ZPG)   OP((ORA<zpg, 3>), "ORA", AM_ZPG)   OP((ASL<zpg, 5>), "ASL", AM_ZPG)   OP((SLO<zpg, 5>), "SLO", AM_ZPG)   OP((PHP<3>), "PHP", AM_IMP)        OP((ORA<imm, 2>), "ORA", AM_IMM)   OP((ASLA<2>), "ASL", AM_ACC)       OP((nop<0>), "???", AM_IMP)        OP((NOP<abs, 4>), "NOP", AM_ABS)   OP((ORA<abs, 4>), "ORA", AM_ABS)   OP((ASL<abs, 6>), "ASL", AM_ABS)   OP((SLO<abs, 6>), "SLO", AM_ABS) \
+	/*1*/ OP((BPL<rel, 2>), "BPL", AM_REL)   OP((ORA<indyp, 5>), "ORA", AM_INY) OP((nop<0>), "???", AM_IMP)        OP((SLO<indy, 8>), "SLO", AM_INY)  OP((NOP<zpgx, 4>), "NOP", AM_ZPX)  OP((ORA<zpgx, 4>), "ORA", AM_ZPX)  OP((ASL<zpgx, 6>), "ASL", AM_ZPX)  OP((SLO<zpgx, 6>), "SLO", AM_ZPX)  OP((CLC<2>), "CLC", AM_IMP)        OP((ORA<absyp, 4>), "ORA", AM_ABY) OP((nop<2>), "NOP", AM_IMP)        OP((SLO<absy, 7>), "SLO", AM_ABY)  OP((NOP<absxp, 4>), "NOP", AM_ABX) OP((ORA<absxp, 4>), "ORA", AM_ABX) OP((ASL<absx, 7>), "ASL", AM_ABX)  OP((SLO<absx, 7>), "SLO", AM_ABX) \
+	/*2*/ OP((JSR<abs, 6>), "JSR", AM_ABS)   OP((AND<xind, 6>), "AND", AM_XIN)  OP((nop<0>), "???", AM_IMP)        OP((RLA<xind, 8>), "RLA", AM_XIN)  OP((BIT<zpg, 3>), "BIT", AM_ZPG)   OP((AND<zpg, 3>), "AND", AM_ZPG)   OP((ROL<zpg, 5>), "ROL", AM_ZPG)   OP((RLA<zpg, 5>), "RLA", AM_ZPG)   OP((PLP<4>), "PLP", AM_IMP)        OP((AND<imm, 2>), "AND", AM_IMM)   OP((ROLA<2>), "ROL", AM_ACC)       OP((nop<0>), "???", AM_IMP)        OP((BIT<abs, 4>), "BIT", AM_ABS)   OP((AND<abs, 4>), "AND", AM_ABS)   OP((ROL<abs, 6>), "ROL", AM_ABS)   OP((RLA<abs, 6>), "RLA", AM_ABS) \
+	/*3*/ OP((BMI<rel, 2>), "BMI", AM_REL)   OP((AND<indyp, 5>), "AND", AM_INY) OP((nop<0>), "???", AM_IMP)        OP((RLA<indy, 8>), "RLA", AM_INY)  OP((NOP<zpgx, 4>), "NOP", AM_ZPX)  OP((AND<zpgx, 4>), "AND", AM_ZPX)  OP((ROL<zpgx, 6>), "ROL", AM_ZPX)  OP((RLA<zpgx, 6>), "RLA", AM_ZPX)  OP((SEC<2>), "SEC", AM_IMP)        OP((AND<absyp, 4>), "AND", AM_ABY) OP((nop<2>), "NOP", AM_IMP)        OP((RLA<absy, 7>), "RLA", AM_ABY)  OP((NOP<absxp, 4>), "NOP", AM_ABX) OP((AND<absxp, 4>), "AND", AM_ABX) OP((ROL<absx, 7>), "ROL", AM_ABX)  OP((RLA<absx, 7>), "RLA", AM_ABX) \
+	/*4*/ OP((RTI<6>), "RTI", AM_IMP)        OP((EOR<xind, 6>), "EOR", AM_XIN)  OP((nop<0>), "???", AM_IMP)        OP((SRE<xind, 8>), "SRE", AM_XIN)  OP((NOP<zpg, 3>), "NOP", AM_ZPG)   OP((EOR<zpg, 3>), "EOR", AM_ZPG)   OP((LSR<zpg, 5>), "LSR", AM_ZPG)   OP((SRE<zpg, 5>), "SRE", AM_ZPG)   OP((PHA<3>), "PHA", AM_IMP)        OP((EOR<imm, 2>), "EOR", AM_IMM)   OP((LSRA<2>), "LSR", AM_ACC)       OP((nop<0>), "???", AM_IMP)        OP((JMP<abs, 3>), "JMP", AM_ABS)   OP((EOR<abs, 4>), "EOR", AM_ABS)   OP((LSR<abs, 6>), "LSR", AM_ABS)   OP((SRE<abs, 6>), "SRE", AM_ABS) \
+	/*5*/ OP((BVC<rel, 2>), "BVC", AM_REL)   OP((EOR<indyp, 5>), "EOR", AM_INY) OP((nop<0>), "???", AM_IMP)        OP((SRE<indy, 8>), "SRE", AM_INY)  OP((NOP<zpgx, 4>), "NOP", AM_ZPX)  OP((EOR<zpgx, 4>), "EOR", AM_ZPX)  OP((LSR<zpgx, 6>), "LSR", AM_ZPX)  OP((SRE<zpgx, 6>), "SRE", AM_ZPX)  OP((CLI<2>), "CLI", AM_IMP)        OP((EOR<absyp, 4>), "EOR", AM_ABY) OP((nop<2>), "NOP", AM_IMP)        OP((SRE<absy, 7>), "SRE", AM_ABY)  OP((NOP<absxp, 4>), "NOP", AM_ABX) OP((EOR<absxp, 4>), "EOR", AM_ABX) OP((LSR<absx, 7>), "LSR", AM_ABX)  OP((SRE<absx, 7>), "SRE", AM_ABX) \
+	/*6*/ OP((RTS<6>), "RTS", AM_IMP)        OP((ADC<xind, 6>), "ADC", AM_XIN)  OP((nop<0>), "???", AM_IMP)        OP((RRA<xind, 8>), "RRA", AM_XIN)  OP((NOP<zpg, 3>), "NOP", AM_ZPG)   OP((ADC<zpg, 3>), "ADC", AM_ZPG)   OP((ROR<zpg, 5>), "ROR", AM_ZPG)   OP((RRA<zpg, 5>), "RRA", AM_ZPG)   OP((PLA<4>), "PLA", AM_IMP)        OP((ADC<imm, 2>), "ADC", AM_IMM)   OP((RORA<2>), "ROR", AM_ACC)       OP((nop<0>), "???", AM_IMP)        OP((JMP<ind, 5>), "JMP", AM_IND)   OP((ADC<abs, 4>), "ADC", AM_ABS)   OP((ROR<abs, 6>), "ROR", AM_ABS)   OP((RRA<abs, 6>), "RRA", AM_ABS) \
+	/*7*/ OP((BVS<rel, 2>), "BVS", AM_REL)   OP((ADC<indyp, 5>), "ADC", AM_INY) OP((nop<0>), "???", AM_IMP)        OP((RRA<indy, 8>), "RRA", AM_INY)  OP((NOP<zpgx, 4>), "NOP", AM_ZPX)  OP((ADC<zpgx, 4>), "ADC", AM_ZPX)  OP((ROR<zpgx, 6>), "ROR", AM_ZPX)  OP((RRA<zpgx, 6>), "RRA", AM_ZPX)  OP((SEI<2>), "SEI", AM_IMP)        OP((ADC<absyp, 4>), "ADC", AM_ABY) OP((nop<2>), "NOP", AM_IMP)        OP((RRA<absy, 7>), "RRA", AM_ABY)  OP((NOP<absxp, 4>), "NOP", AM_ABX) OP((ADC<absxp, 4>), "ADC", AM_ABX) OP((ROR<absx, 7>), "ROR", AM_ABX)  OP((RRA<absx, 7>), "RRA", AM_ABX) \
+	/*8*/ OP((NOP<imm, 2>), "NOP", AM_IMM)   OP((STA<xind, 6>), "STA", AM_XIN)  OP((NOP<imm, 2>), "NOP", AM_IMM)   OP((SAX<xind, 6>), "SAX", AM_XIN)  OP((STY<zpg, 3>), "STY", AM_ZPG)   OP((STA<zpg, 3>), "STA", AM_ZPG)   OP((STX<zpg, 3>), "STX", AM_ZPG)   OP((SAX<zpg, 3>), "SAX", AM_ZPG)   OP((DEY<2>), "DEY", AM_IMP)        OP((NOP<imm, 2>), "NOP", AM_IMM)   OP((TXA<2>), "TXA", AM_IMP)        OP((nop<0>), "???", AM_IMP)        OP((STY<abs, 4>), "STY", AM_ABS)   OP((STA<abs, 4>), "STA", AM_ABS)   OP((STX<abs, 4>), "STX", AM_ABS)   OP((SAX<abs, 4>), "SAX", AM_ABS) \
+	/*9*/ OP((BCC<rel, 2>), "BCC", AM_REL)   OP((STA<indy, 6>), "STA", AM_INY)  OP((nop<0>), "???", AM_IMP)        OP((nop<0>), "???", AM_IMP)        OP((STY<zpgx, 4>), "STY", AM_ZPX)  OP((STA<zpgx, 4>), "STA", AM_ZPX)  OP((STX<zpgy, 4>), "STX", AM_ZPY)  OP((SAX<zpgy, 4>), "SAX", AM_ZPY)  OP((TYA<2>), "TYA", AM_IMP)        OP((STA<absy, 5>), "STA", AM_ABY)  OP((TXS<2>), "TXS", AM_IMP)        OP((nop<0>), "???", AM_IMP)        OP((nop<0>), "???", AM_IMP)        OP((STA<absx, 5>), "STA", AM_ABX)  OP((nop<0>), "???", AM_IMP)        OP((nop<0>), "???", AM_IMP) \
+	/*A*/ OP((LDY<imm, 2>), "LDY", AM_IMM)   OP((LDA<xind, 6>), "LDA", AM_XIN)  OP((LDX<imm, 2>), "LDX", AM_IMM)   OP((LAX<xind, 6>), "LAX", AM_XIN)  OP((LDY<zpg, 3>), "LDY", AM_ZPG)   OP((LDA<zpg, 3>), "LDA", AM_ZPG)   OP((LDX<zpg, 3>), "LDX", AM_ZPG)   OP((LAX<zpg, 3>), "LAX", AM_ZPG)   OP((TAY<2>), "TAY", AM_IMP)        OP((LDA<imm, 2>), "LDA", AM_IMM)   OP((TAX<2>), "TAX", AM_IMP)        OP((nop<0>), "???", AM_IMP)        OP((LDY<abs, 4>), "LDY", AM_ABS)   OP((LDA<abs, 4>), "LDA", AM_ABS)   OP((LDX<abs, 4>), "LDX", AM_ABS)   OP((LAX<abs, 4>), "LAX", AM_ABS) \
+	/*B*/ OP((BCS<rel, 2>), "BCS", AM_REL)   OP((LDA<indyp, 5>), "LDA", AM_INY) OP((nop<0>), "???", AM_IMP)        OP((LAX<indyp, 5>), "LAX", AM_INY) OP((LDY<zpgx, 4>), "LDY", AM_ZPX)  OP((LDA<zpgx, 4>), "LDA", AM_ZPX)  OP((LDX<zpgy, 4>), "LDX", AM_ZPY)  OP((LAX<zpgy, 4>), "LAX", AM_ZPY)  OP((CLV<2>), "CLV", AM_IMP)        OP((LDA<absyp, 4>), "LDA", AM_ABY) OP((TSX<2>), "TSX", AM_IMP)        OP((nop<0>), "???", AM_IMP)        OP((LDY<absxp, 4>), "LDY", AM_ABX) OP((LDA<absxp, 4>), "LDA", AM_ABX) OP((LDX<absyp, 4>), "LDX", AM_ABY) OP((LAX<absyp, 4>), "LAX", AM_ABY) \
+	/*C*/ OP((CPY<imm, 2>), "CPY", AM_IMM)   OP((CMP<xind, 6>), "CMP", AM_XIN)  OP((NOP<imm, 2>), "NOP", AM_IMM)   OP((DCP<xind, 8>), "DCP", AM_XIN)  OP((CPY<zpg, 3>), "CPY", AM_ZPG)   OP((CMP<zpg, 3>), "CMP", AM_ZPG)   OP((DEC<zpg, 5>), "DEC", AM_ZPG)   OP((DCP<zpg, 5>), "DCP", AM_ZPG)   OP((INY<2>), "INY", AM_IMP)        OP((CMP<imm, 2>), "CMP", AM_IMM)   OP((DEX<2>), "DEX", AM_IMP)        OP((nop<0>), "???", AM_IMP)        OP((CPY<abs, 4>), "CPY", AM_ABS)   OP((CMP<abs, 4>), "CMP", AM_ABS)   OP((DEC<abs, 6>), "DEC", AM_ABS)   OP((DCP<abs, 6>), "DCP", AM_ABS) \
+	/*D*/ OP((BNE<rel, 2>), "BNE", AM_REL)   OP((CMP<indyp, 5>), "CMP", AM_INY) OP((nop<0>), "???", AM_IMP)        OP((DCP<indy, 8>), "DCP", AM_INY)  OP((NOP<zpgx, 4>), "NOP", AM_ZPX)  OP((CMP<zpgx, 4>), "CMP", AM_ZPX)  OP((DEC<zpgx, 6>), "DEC", AM_ZPX)  OP((DCP<zpgx, 6>), "DCP", AM_ZPX)  OP((CLD<2>), "CLD", AM_IMP)        OP((CMP<absyp, 4>), "CMP", AM_ABY) OP((nop<2>), "NOP", AM_IMP)        OP((DCP<absy, 7>), "DCP", AM_ABY)  OP((NOP<absxp, 4>), "NOP", AM_ABX) OP((CMP<absxp, 4>), "CMP", AM_ABX) OP((DEC<absx, 7>), "DEC", AM_ABX)  OP((DCP<absx, 7>), "DCP", AM_ABX) \
+	/*E*/ OP((CPX<imm, 2>), "CPX", AM_IMM)   OP((SBC<xind, 6>), "SBC", AM_XIN)  OP((NOP<imm, 2>), "NOP", AM_IMM)   OP((ISB<xind, 8>), "ISB", AM_XIN)  OP((CPX<zpg, 3>), "CPX", AM_ZPG)   OP((SBC<zpg, 3>), "SBC", AM_ZPG)   OP((INC<zpg, 5>), "INC", AM_ZPG)   OP((ISB<zpg, 5>), "ISB", AM_ZPG)   OP((INX<2>), "INX", AM_IMP)        OP((SBC<imm, 2>), "SBC", AM_IMM)   OP((nop<2>), "NOP", AM_IMP)        OP((SBC<imm, 2>), "SBC", AM_IMM)   OP((CPX<abs, 4>), "CPX", AM_ABS)   OP((SBC<abs, 4>), "SBC", AM_ABS)   OP((INC<abs, 6>), "INC", AM_ABS)   OP((ISB<abs, 6>), "ISB", AM_ABS) \
+	/*F*/ OP((BEQ<rel, 2>), "BEQ", AM_REL)   OP((SBC<indyp, 5>), "SBC", AM_INY) OP((nop<0>), "???", AM_IMP)        OP((ISB<indy, 8>), "ISB", AM_INY)  OP((NOP<zpgx, 4>), "NOP", AM_ZPX)  OP((SBC<zpgx, 4>), "SBC", AM_ZPX)  OP((INC<zpgx, 6>), "INC", AM_ZPX)  OP((ISB<zpgx, 6>), "ISB", AM_ZPX)  OP((SED<2>), "SED", AM_IMP)        OP((SBC<absyp, 4>), "SBC", AM_ABY) OP((nop<2>), "NOP", AM_IMP)        OP((ISB<absy, 7>), "ISB", AM_ABY)  OP((NOP<absxp, 4>), "NOP", AM_ABX) OP((SBC<absxp, 4>), "SBC", AM_ABX) OP((INC<absx, 7>), "INC", AM_ABX)  OP((ISB<absx, 7>), "ISB", AM_ABX)
+
 static const mos6502instruction cpuopmap[256] = {
-	//  0      , 1            , 2          , 3     , 4           , 5           , 6           , 7     , 8     , 9           , A          , B     , C           , D           , E           , F
-	BRK<7>     , ORA<xind , 6>, nop<0>     , nop<0>, nop<0>      , ORA<zpg, 3> , ASL<zpg, 5> , nop<0>, PHP<3>, ORA<imm, 2> , ASLA<2>, nop<0>, nop<0>      , ORA<abs, 4> , ASL<abs, 6> , nop<0>,//0
-	BPL<rel, 2>, ORA<indy , 5>, nop<0>     , nop<0>, nop<0>      , ORA<zpgx, 4>, ASL<zpgx, 6>, nop<0>, CLC<2>, ORA<absy, 4>, nop<0> , nop<0>, nop<0>      , ORA<absx, 4>, ASL<absx, 7>, nop<0>,//1
-	JSR<abs, 6>, AND<xind , 6>, nop<0>     , nop<0>, BIT<zpg, 3> , AND<zpg, 3> , ROL<zpg, 5> , nop<0>, PLP<4>, AND<imm, 2> , ROLA<2>, nop<0>, BIT<abs, 4> , AND<abs, 4> , ROL<abs, 6> , nop<0>,//2
-	BMI<rel, 2>, AND<indy , 5>, nop<0>     , nop<0>, nop<0>      , AND<zpgx, 4>, ROL<zpgx, 6>, nop<0>, SEC<2>, AND<absy, 4>, nop<0> , nop<0>, nop<0>      , AND<absx, 4>, ROL<absx, 7>, nop<0>,//3
-	RTI<6>     , EOR<xind , 6>, nop<0>     , nop<0>, nop<0>      , EOR<zpg, 3> , LSR<zpg, 5> , nop<0>, PHA<3>, EOR<imm, 2> , LSRA<2>, nop<0>, JMP<abs, 3> , EOR<abs, 4> , LSR<abs, 6> , nop<0>,//4
-	BVC<rel, 2>, EOR<indy , 5>, nop<0>     , nop<0>, nop<0>      , EOR<zpgx, 4>, LSR<zpgx, 6>, nop<0>, CLI<2>, EOR<absy, 4>, nop<0> , nop<0>, nop<0>      , EOR<absx, 4>, LSR<absx, 7>, nop<0>,//5
-	RTS<6>     , ADC<xind , 6>, nop<0>     , nop<0>, nop<0>      , ADC<zpg, 3> , ROR<zpg, 5> , nop<0>, PLA<4>, ADC<imm, 2> , RORA<2>, nop<0>, JMP<ind, 5> , ADC<abs, 4> , ROR<abs, 6> , nop<0>,//6
-	BVS<rel, 2>, ADC<indy , 5>, nop<0>     , nop<0>, nop<0>      , ADC<zpgx, 4>, ROR<zpgx, 6>, nop<0>, SEI<2>, ADC<absy, 4>, nop<0> , nop<0>, nop<0>      , ADC<absx, 4>, ROR<absx, 7>, nop<0>,//7
-	nop<0>     , STA<xind , 6>, nop<0>     , nop<0>, STY<zpg, 3> , STA<zpg, 3> , STX<zpg, 3> , nop<0>, DEY<2>, nop<0>      , TXA<2> , nop<0>, STY<abs, 3> , STA<abs, 4> , STX<abs, 4> , nop<0>,//8
-	BCC<rel, 2>, STA<indy , 6>, nop<0>     , nop<0>, STY<zpgx, 4>, STA<zpgx, 4>, STX<zpgy, 4>, nop<0>, TYA<2>, STA<absy, 5>, TXS<2> , nop<0>, nop<0>      , STA<absx, 5>, nop<0>      , nop<0>,//9
-	LDY<imm, 2>, LDA<xind , 6>, LDX<imm, 2>, nop<0>, LDY<zpg, 3> , LDA<zpg, 3> , LDX<zpg, 3> , nop<0>, TAY<2>, LDA<imm, 2> , TAX<2> , nop<0>, LDY<abs, 4> , LDA<abs, 4> , LDX<abs, 4> , nop<0>,//a
-	BCS<rel, 2>, LDA<indy , 5>, nop<0>     , nop<0>, LDY<zpgx, 4>, LDA<zpgx, 4>, LDX<zpgy, 4>, nop<0>, CLV<2>, LDA<absy, 4>, TSX<2> , nop<0>, LDY<absx, 4>, LDA<absx, 4>, LDX<absy, 4>, nop<0>,//b
-	CPY<imm, 2>, CMP<xind , 6>, nop<0>     , nop<0>, CPY<zpg, 4> , CMP<zpg, 3> , DEC<zpg, 5> , nop<0>, INY<2>, CMP<imm, 2> , DEX<2> , nop<0>, CPY<abs, 4> , CMP<abs, 4> , DEC<abs, 3> , nop<0>,//c
-	BNE<rel, 2>, CMP<indy , 5>, nop<0>     , nop<0>, nop<0>      , CMP<zpgx, 4>, DEC<zpg, 6> , nop<0>, CLD<2>, CMP<absy, 4>, nop<0> , nop<0>, nop<0>      , CMP<absx, 4>, DEC<absx, 7>, nop<0>,//d
-	CPX<imm, 2>, SBC<xind , 6>, nop<0>     , nop<0>, CPX<zpg, 3> , SBC<zpg, 3> , INC<zpg, 5> , nop<0>, INX<2>, SBC<imm, 2> , nop<2> , nop<0>, CPX<abs, 4> , SBC<abs, 4> , INC<abs, 6> , nop<0>,//e
-	BEQ<rel, 2>, SBC<indy , 5>, nop<0>     , nop<0>, nop<0>      , SBC<zpgx, 4>, INC<zpgx, 6>, nop<0>, CLV<2>, SBC<absy, 4>, nop<0> , nop<0>, nop<0>      , SBC<absx, 4>, INC<absx, 7>, nop<0>,//f
+#define OP_HANDLER(handler, name, mode) handler,
+	CPU_OPCODES(OP_HANDLER)
+#undef OP_HANDLER
 };
 
+static const cpuOpInfo cpuopinfo[256] = {
+#define OP_INFO(handler, name, mode) { name, mode },
+	CPU_OPCODES(OP_INFO)
+#undef OP_INFO
+};
+
+const cpuOpInfo& opInfo(uint8_t opcode) {
+	return cpuopinfo[opcode];
+}
+
+uint8_t opLength(uint8_t mode) {
+	switch (mode) {
+	case AM_IMP:
+	case AM_ACC:
+		return 1;
+	case AM_ABS:
+	case AM_ABX:
+	case AM_ABY:
+	case AM_IND:
+		return 3;
+	default:
+		return 2;
+	}
+}
+
+bool endsBlock(uint8_t opcode) {
+	return cpuopinfo[opcode].mode == AM_REL || opcode == OP_BRK || opcode == OP_JSR || opcode == OP_RTI
+		|| opcode == OP_JMP || opcode == OP_RTS || opcode == OP_JMPI;
+}
+
+//fills the entry at a rom offset straight from the devices so a watchpoint never sees it,
+//instructions running past the end of prg are left to the bus
+bool decodeOp(mos6502& _cpu, uint32_t offset) {
+	uint16_t address = (uint16_t)(DECODE_BASE + offset);
+	uint8_t opcode = deviceRead(_cpu, address);
+	uint8_t length = opLength(cpuopinfo[opcode].mode);
+	if (offset + length > _cpu.decodedMask + 1)
+		return false;
+	decodedOp& op = _cpu.decoded[offset];
+	op.operand = length > 1 ? deviceRead(_cpu, address + 1) : 0;
+	if (length > 2)
+		op.operand |= deviceRead(_cpu, address + 2) << 8;
+	op.opcode = opcode;
+	op.length = length;
+	op.blockBytes = 0;
+	op.handler = cpuopmap[opcode];
+	return true;
+}
+
+//the entry of the instruction at address, decoding it on first use. null when the instruction has
+//to go through the bus: outside the rom, on a trapped page or running past the end of prg
+decodedOp* cachedOp(mos6502& _cpu, uint16_t address) {
+	if (!_cpu.decoded || address < DECODE_BASE || _cpu.pageRead[address >> 8] != &(deviceRead))
+		return nullptr;
+	uint32_t offset = (address - DECODE_BASE) & _cpu.decodedMask;
+	decodedOp& op = _cpu.decoded[offset];
+	if (!op.handler && !decodeOp(_cpu, offset))
+		return nullptr;
+	//operand bytes on the next page have to see a trap there as well
+	if ((address & 0xFF) + op.length > 0x100 && _cpu.pageRead[(uint8_t)((address >> 8) + 1)] != &(deviceRead))
+		return nullptr;
+	return &op;
+}
+
+//a block runs up to and including its first change of flow and never past the end of prg
+void decodeBlock(mos6502& _cpu, decodedOp& first) {
+	uint32_t offset = (uint32_t)(&first - _cpu.decoded);
+	uint32_t bytes = 0;
+	for (int n = 0; n < BLOCK_MAX_INSTRUCTIONS && offset + bytes <= _cpu.decodedMask; n++) {
+		decodedOp& op = _cpu.decoded[offset + bytes];
+		if (!op.handler && !decodeOp(_cpu, offset + bytes))
+			break;
+		bytes += op.length;
+		if (endsBlock(op.opcode))
+			break;
+	}
+	first.blockBytes = (uint16_t)bytes;
+}
+
+const decodedOp* decodedBlock(mos6502& _cpu) {
+	decodedOp* op = cachedOp(_cpu, _cpu.PC);
+	if (!op)
+		return nullptr;
+	if (!op->blockBytes)
+		decodeBlock(_cpu, *op);
+	//a watchpoint anywhere in the block sends it back through stepCpu
+	uint32_t last = (uint32_t)_cpu.PC + op->blockBytes - 1;
+	for (uint32_t page = (_cpu.PC >> 8) + 1; page <= (last >> 8); page++) {
+		if (_cpu.pageRead[page] != &(deviceRead))
+			return nullptr;
+	}
+	return op;
+}
+
+bool prefillBlock(mos6502& _cpu, uint32_t offset, uint16_t bytes) {
+	uint32_t end = offset + bytes;
+	if (!_cpu.decoded || !bytes || end > _cpu.decodedMask + 1)
+		return false;
+	uint32_t at = offset;
+	while (at < end) {
+		decodedOp& op = _cpu.decoded[at];
+		if (!op.handler && !decodeOp(_cpu, at))
+			return false;
+		at += op.length;
+		//only the last instruction may leave straight line code
+		if (endsBlock(op.opcode) && at != end)
+			return false;
+	}
+	if (at != end)
+		return false;
+	_cpu.decoded[offset].blockBytes = bytes;
+	return true;
+}
+
+int runDecoded(mos6502& _cpu, const decodedOp& op) {
+	uint64_t start = _cpu.cycles;
+	_cpu.PC++;
+	_cpu.current = &op;
+	_cpu.cycles += op.handler(_cpu);
+	_cpu.current = nullptr;
+	return (int)(_cpu.cycles - start);
+}
+
 int stepCpu(mos6502& _cpu) {
-	printf("running instruction from 0x%04X\n", _cpu.PC);
+	const decodedOp* op = cachedOp(_cpu, _cpu.PC);
+	if (op)
+		return runDecoded(_cpu, *op);
+	uint64_t start = _cpu.cycles;
 	uint8_t opcode = basicRead(_cpu, _cpu.PC++);
-	printf("running 0x%02X\n", opcode);
-	return cpuopmap[opcode](_cpu);
-}
\ No newline at end of file
+	//page crossings and taken branches add their extra cycles to the counter directly
+	_cpu.cycles += cpuopmap[opcode](_cpu);
+	return (int)(_cpu.cycles - start);
+}
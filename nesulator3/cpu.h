@@ -2,8 +2,23 @@
 #define cpu
 
 #include <stdint.h>
+#include <stddef.h>
 #include "emulatorGlue.h"
 
+struct mos6502;
+typedef uint8_t(*busReadHandler)(mos6502&, uint16_t);
+typedef void(*busWriteHandler)(mos6502&, uint16_t, uint8_t);
+typedef int (*mos6502instruction)(mos6502&);
+
+//one rom instruction, decoded the first time it runs or from an analysis sidecar
+struct decodedOp {
+	mos6502instruction handler;//null until decoded
+	uint16_t operand;//the bytes after the opcode, little endian
+	uint8_t opcode;
+	uint8_t length;
+	uint16_t blockBytes;//straight line code from here up to and including the next change of flow, 0 until known
+};
+
 struct mos6502 {
 public:
 	uint8_t A, X, Y, SP;
@@ -12,21 +27,81 @@ public:
 	uint8_t interupts;
 	device816* devices;
 	size_t deviceCount;
+	uint64_t cycles;
+	//every bus access goes through its page's handler, normally the device search, so a
+	//page can be swapped for a trapping handler without slowing down any other page
+	busReadHandler pageRead[256];
+	busWriteHandler pageWrite[256];
+	void* trapdata;
+	//decode cache over the cartridge rom from DECODE_BASE up, indexed by rom offset so mirrors share
+	//entries. null for buses where that range is not fixed rom
+	decodedOp* decoded;
+	uint32_t decodedMask;
+	const decodedOp* current;//entry of the instruction being run from the cache, its operand replaces the bus reads
 };
 
 struct cpuState {
-	uint8_t A, X, Y;
+	uint8_t A, X, Y, SP;
 	uint16_t PC;
 	uint8_t FLAGS;
 };
+
+#define IRQ_VEC 0xFFFE
+#define NMI_VEC 0xFFFA
+#define BRK_VEC 0xFFFE
+#define RST_VEC 0xFFFC
+
+#define DECODE_BASE 0x8000
+#define BLOCK_MAX_INSTRUCTIONS 255
+
+//the opcodes other than branches that take control out of straight line code
+#define OP_BRK 0x00
+#define OP_JSR 0x20
+#define OP_RTI 0x40
+#define OP_JMP 0x4C
+#define OP_RTS 0x60
+#define OP_JMPI 0x6C
+
+//addressing modes as listed in cpuopinfo
+#define AM_IMP 0
+#define AM_ACC 1
+#define AM_IMM 2
+#define AM_ZPG 3
+#define AM_ZPX 4
+#define AM_ZPY 5
+#define AM_ABS 6
+#define AM_ABX 7
+#define AM_ABY 8
+#define AM_IND 9
+#define AM_XIN 10
+#define AM_INY 11
+#define AM_REL 12
+
+struct cpuOpInfo {
+	const char* name;
+	uint8_t mode;
+};
+
 void createCpu(mos6502&);
 bool addDevice(mos6502&, device816&);
 int stepCpu(mos6502&);
+//the cache entry at PC when its whole block can run from the cache, decoding the block on first use
+const decodedOp* decodedBlock(mos6502&);
+//runs the instruction at PC from its cache entry
+int runDecoded(mos6502&, const decodedOp&);
+//decodes a block found ahead of time, false when it does not hold exactly one straight line run
+bool prefillBlock(mos6502&, uint32_t offset, uint16_t bytes);
+uint8_t busRead816(void*, uint16_t);
+uint8_t deviceRead(mos6502&, uint16_t);
+void deviceWrite(mos6502&, uint16_t, uint8_t);
+void trapPage(mos6502&, uint8_t page, busReadHandler, busWriteHandler);
+void untrapPage(mos6502&, uint8_t page);
+const cpuOpInfo& opInfo(uint8_t opcode);
+uint8_t opLength(uint8_t mode);
+bool endsBlock(uint8_t opcode);
 
 void triggerNMI(mos6502& _cpu);
 void triggerRST(mos6502& _cpu);
 void triggerIRQ(mos6502& _cpu);
 
-
-typedef int (*mos6502instruction)(mos6502&);
 #endif // !cpu
\ No newline at end of file
@@ -0,0 +1,149 @@
+#include "debugger.h"
+
+#include <stdio.h>
+#include <cstring>
+
+/*
+###################################--- PAGE TRAPS ---#######################################
+*/
+
+uint8_t watchRead(mos6502& _cpu, uint16_t address) {
+	debugger* dbg = (debugger*)_cpu.trapdata;
+	uint8_t value = deviceRead(_cpu, address);
+	if ((dbg->flags[address] & DEBUG_WATCH_READ) && dbg->stopReason == STOP_NONE) {
+		dbg->stopReason = STOP_WATCH_READ;
+		dbg->stopAddress = address;
+		dbg->stopValue = value;
+	}
+	return value;
+}
+
+void watchWrite(mos6502& _cpu, uint16_t address, uint8_t value) {
+	debugger* dbg = (debugger*)_cpu.trapdata;
+	if ((dbg->flags[address] & DEBUG_WATCH_WRITE) && dbg->stopReason == STOP_NONE) {
+		dbg->stopReason = STOP_WATCH_WRITE;
+		dbg->stopAddress = address;
+		dbg->stopValue = value;
+	}
+	deviceWrite(_cpu, address, value);
+}
+
+/*
+###################################--- PUBLIC FUNCTIONS ---#######################################
+*/
+
+void createDebugger(debugger& dbg, nes& _nes) {
+	dbg.machine = &_nes;
+	memset(dbg.flags, 0, sizeof(dbg.flags));
+	memset(dbg.pageWatches, 0, sizeof(dbg.pageWatches));
+	memset(dbg.pageBreaks, 0, sizeof(dbg.pageBreaks));
+	dbg.stopReason = STOP_NONE;
+	dbg.stopAddress = 0;
+	dbg.stopValue = 0;
+	_nes.mycpu.trapdata = &dbg;
+}
+
+void destroyDebugger(debugger& dbg) {
+	for (int page = 0; page < 256; page++) {
+		if (dbg.pageWatches[page])
+			untrapPage(dbg.machine->mycpu, (uint8_t)page);
+	}
+	dbg.machine->mycpu.trapdata = nullptr;
+}
+
+void setBreakpoint(debugger& dbg, uint16_t address, bool enabled) {
+	bool current = dbg.flags[address] & DEBUG_BREAK_EXEC;
+	if (current == enabled)
+		return;
+	dbg.flags[address] ^= DEBUG_BREAK_EXEC;
+	dbg.pageBreaks[address >> 8] += enabled ? 1 : -1;
+}
+
+void setWatchpoint(debugger& dbg, uint16_t address, uint8_t kinds, bool enabled) {
+	kinds &= DEBUG_WATCH_READ | DEBUG_WATCH_WRITE;
+	bool watched = dbg.flags[address] & (DEBUG_WATCH_READ | DEBUG_WATCH_WRITE);
+	if (enabled) dbg.flags[address] |= kinds;
+	else dbg.flags[address] &= ~kinds;
+	bool nowWatched = dbg.flags[address] & (DEBUG_WATCH_READ | DEBUG_WATCH_WRITE);
+	if (watched == nowWatched)
+		return;
+	uint8_t page = address >> 8;
+	if (nowWatched && dbg.pageWatches[page]++ == 0)
+		trapPage(dbg.machine->mycpu, page, &(watchRead), &(watchWrite));
+	else if (!nowWatched && --dbg.pageWatches[page] == 0)
+		untrapPage(dbg.machine->mycpu, page);
+}
+
+uint8_t debugStep(debugger& dbg) {
+	dbg.stopReason = STOP_NONE;
+	stepNES(*dbg.machine);
+	if (dbg.stopReason == STOP_NONE)
+		dbg.stopReason = STOP_STEP;
+	return dbg.stopReason;
+}
+
+//runs until a breakpoint or watchpoint is hit, always executing at least one instruction
+//so continuing from a breakpoint moves past it
+uint8_t debugContinue(debugger& dbg, uint64_t maxCycles) {
+	mos6502& _cpu = dbg.machine->mycpu;
+	uint64_t end = _cpu.cycles + maxCycles;
+	dbg.stopReason = STOP_NONE;
+	do {
+		stepNES(*dbg.machine);
+		if (dbg.stopReason != STOP_NONE)
+			return dbg.stopReason;
+		if (dbg.pageBreaks[_cpu.PC >> 8] && (dbg.flags[_cpu.PC] & DEBUG_BREAK_EXEC)) {
+			dbg.stopReason = STOP_BREAKPOINT;
+			dbg.stopAddress = _cpu.PC;
+			return dbg.stopReason;
+		}
+	} while (_cpu.cycles < end);
+	dbg.stopReason = STOP_CYCLE_LIMIT;
+	return dbg.stopReason;
+}
+
+cpuState debugRegisters(debugger& dbg) {
+	mos6502& _cpu = dbg.machine->mycpu;
+	cpuState state;
+	state.A = _cpu.A;
+	state.X = _cpu.X;
+	state.Y = _cpu.Y;
+	state.SP = _cpu.SP;
+	state.PC = _cpu.PC;
+	state.FLAGS = _cpu.flags;
+	return state;
+}
+
+//memory only, reading io registers has side effects so they report false instead
+bool debugPeek(debugger& dbg, uint16_t address, uint8_t& value) {
+	if (address >= 0x2000 && address < 0x6000)
+		return false;
+	value = deviceRead(dbg.machine->mycpu, address);
+	return true;
+}
+
+uint8_t disassemble(debugger& dbg, uint16_t address, char* out, size_t size) {
+	uint8_t opcode = 0, lo = 0, hi = 0;
+	debugPeek(dbg, address, opcode);
+	const cpuOpInfo& info = opInfo(opcode);
+	uint8_t length = opLength(info.mode);
+	if (length > 1) debugPeek(dbg, address + 1, lo);
+	if (length > 2) debugPeek(dbg, address + 2, hi);
+	uint16_t word = lo | (hi << 8);
+	switch (info.mode) {
+	case AM_IMP: snprintf(out, size, "%s", info.name); break;
+	case AM_ACC: snprintf(out, size, "%s A", info.name); break;
+	case AM_IMM: snprintf(out, size, "%s #$%02X", info.name, lo); break;
+	case AM_ZPG: snprintf(out, size, "%s $%02X", info.name, lo); break;
+	case AM_ZPX: snprintf(out, size, "%s $%02X,X", info.name, lo); break;
+	case AM_ZPY: snprintf(out, size, "%s $%02X,Y", info.name, lo); break;
+	case AM_ABS: snprintf(out, size, "%s $%04X", info.name, word); break;
+	case AM_ABX: snprintf(out, size, "%s $%04X,X", info.name, word); break;
+	case AM_ABY: snprintf(out, size, "%s $%04X,Y", info.name, word); break;
+	case AM_IND: snprintf(out, size, "%s ($%04X)", info.name, word); break;
+	case AM_XIN: snprintf(out, size, "%s ($%02X,X)", info.name, lo); break;
+	case AM_INY: snprintf(out, size, "%s ($%02X),Y", info.name, lo); break;
+	case AM_REL: snprintf(out, size, "%s $%04X", info.name, (uint16_t)(address + 2 + (int8_t)lo)); break;
+	}
+	return length;
+}
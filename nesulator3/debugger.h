@@ -0,0 +1,39 @@
+#ifndef nesdebugger
+#define nesdebugger
+
+#include "nes.h"
+
+#define DEBUG_BREAK_EXEC 0x01
+#define DEBUG_WATCH_READ 0x02
+#define DEBUG_WATCH_WRITE 0x04
+
+#define STOP_NONE 0
+#define STOP_STEP 1
+#define STOP_BREAKPOINT 2
+#define STOP_WATCH_READ 3
+#define STOP_WATCH_WRITE 4
+#define STOP_CYCLE_LIMIT 5
+
+//watchpoints trap the bus page they live on and breakpoints are only checked by the
+//debugger's own run loop, so anything without a watch or break runs at full speed
+struct debugger {
+	nes* machine;
+	uint8_t flags[0x10000];//DEBUG_* bits per address
+	uint16_t pageWatches[256];
+	uint16_t pageBreaks[256];
+	uint8_t stopReason;
+	uint16_t stopAddress;
+	uint8_t stopValue;
+};
+
+void createDebugger(debugger&, nes&);
+void destroyDebugger(debugger&);
+void setBreakpoint(debugger&, uint16_t address, bool enabled);
+void setWatchpoint(debugger&, uint16_t address, uint8_t kinds, bool enabled);
+uint8_t debugStep(debugger&);
+uint8_t debugContinue(debugger&, uint64_t maxCycles);
+cpuState debugRegisters(debugger&);
+bool debugPeek(debugger&, uint16_t address, uint8_t& value);
+uint8_t disassemble(debugger&, uint16_t address, char* out, size_t size);
+
+#endif
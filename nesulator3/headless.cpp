@@ -0,0 +1,76 @@
+#include "headless.h"
+#include "nes.h"
+#include "movie.h"
+
+#include <cstdlib>
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+//cpu cycles in an ntsc frame, used to find the frames close enough to the cycle limit to be the last
+#define FRAME_CYCLES 29781
+
+//fnv-1a, chosen because it is stable across hosts so hashes can be compared between machines
+uint64_t hashBytes(const uint8_t* data, size_t length, uint64_t seed) {
+	uint64_t hash = seed ? seed : FNV_OFFSET;
+	for (size_t i = 0; i < length; i++) {
+		hash ^= data[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+bool replayMovie(const char* romPath, const char* moviePath, uint64_t cycleLimit, bool verifyHash, replayResult& result) {
+	movie mov;
+	if (!openMovie(mov, moviePath))
+		return false;
+	nes* _nes = (nes*)malloc(sizeof(nes));
+	if (!_nes || !createNES(*_nes, romPath)) {
+		free(_nes);
+		closeMovie(mov);
+		return false;
+	}
+	result.completed = true;
+	result.hashMismatch = false;
+	uint32_t frame = 0;
+	for (; frame < mov.frameCount; frame++) {
+		if (cycleLimit && _nes->mycpu.cycles >= cycleLimit) {
+			result.completed = false;
+			break;
+		}
+		//inputs are latched once per frame, the same as a player holding buttons through it
+		setButtons(_nes->pads, 0, movieInput(mov, frame, 0));
+		setButtons(_nes->pads, 1, movieInput(mov, frame, 1));
+		//only the final frame is reported, earlier ones just need the status flags games poll
+		bool last = frame + 1 == mov.frameCount || (cycleLimit && _nes->mycpu.cycles + 2 * FRAME_CYCLES >= cycleLimit);
+		_nes->myppu.skipRender = !last;
+		//the limit can land inside a frame, that frame is left unfinished and not counted
+		if (!runFrameUntil(*_nes, cycleLimit ? cycleLimit : UINT64_MAX)) {
+			result.completed = false;
+			break;
+		}
+		if (verifyHash && !verifyStateHash(*_nes)) {
+			result.hashMismatch = true;
+			result.completed = false;
+			frame++;
+			break;
+		}
+	}
+	result.frames = frame;
+	result.cycles = _nes->mycpu.cycles;
+	uint8_t ram[0x800];
+	for (uint16_t i = 0; i < 0x800; i++) {
+		ram[i] = _nes->ram.readfun(_nes->ram.data, i);
+	}
+	result.ramHash = hashBytes(ram, sizeof(ram), 0);
+	//framebuffer pages are rows, hashing them in order is the same as hashing the whole frame
+	uint64_t frameHash = 0;
+	for (uint16_t row = 0; row < _nes->myppu.frame.pageCount; row++) {
+		frameHash = hashBytes(_nes->myppu.frame.pages[row]->bytes, MEM_PAGE_SIZE, frameHash);
+	}
+	result.frameHash = frameHash;
+	result.stateHash = stateHash(*_nes);
+	destroyNES(*_nes);
+	free(_nes);
+	closeMovie(mov);
+	return true;
+}
@@ -0,0 +1,20 @@
+#ifndef nesheadless
+#define nesheadless
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct replayResult {
+	uint32_t frames;
+	uint64_t cycles;
+	uint64_t ramHash;
+	uint64_t frameHash;
+	uint64_t stateHash;
+	bool completed;//false when the cycle limit stopped the run early
+	bool hashMismatch;//only set when verifying, the incremental state hash went wrong
+};
+
+uint64_t hashBytes(const uint8_t* data, size_t length, uint64_t seed);
+bool replayMovie(const char* romPath, const char* moviePath, uint64_t cycleLimit, bool verifyHash, replayResult&);
+
+#endif
@@ -1,9 +1,352 @@
 #include "cpu.h"
 #include "memory.h"
+#include "apu.h"
+#include "headless.h"
+#include "debugger.h"
+#include "runahead.h"
+#include "conformance.h"
+#include "shmexport.h"
+#include "analysis.h"
+#include "cartridge.h"
+#include "batch.h"
 
 #include <stdio.h>
+#include <cstring>
+#include <cstdlib>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+int runReplay(int iargs, char** args) {
+	if (iargs < 4) {
+		printf("usage: %s --replay rom.nes movie.nmv [cycle limit] [--verify-hash]\n", args[0]);
+		return -1;
+	}
+	uint64_t limit = 0;
+	bool verify = false;
+	for (int i = 4; i < iargs; i++) {
+		if (strcmp(args[i], "--verify-hash") == 0) verify = true;
+		else limit = strtoull(args[i], nullptr, 0);
+	}
+	replayResult result;
+	if (!replayMovie(args[2], args[3], limit, verify, result))
+		return -1;
+	printf("frames %u\n", result.frames);
+	printf("cycles %llu\n", (unsigned long long)result.cycles);
+	printf("ram %016llx\n", (unsigned long long)result.ramHash);
+	printf("frame %016llx\n", (unsigned long long)result.frameHash);
+	printf("state %016llx\n", (unsigned long long)result.stateHash);
+	if (result.hashMismatch)
+		printf("state hash verification failed\n");
+	else
+		printf("%s\n", result.completed ? "completed" : "cycle limit reached");
+	return result.completed ? 0 : 1;
+}
+
+//plays the movie once per run ahead depth from 0 to the given maximum and reports what each extra frame costs
+int runAheadCost(int iargs, char** args) {
+	if (iargs < 4) {
+		printf("usage: %s --runahead rom.nes movie.nmv [max frames ahead]\n", args[0]);
+		return -1;
+	}
+	int maxAhead = iargs > 4 ? atoi(args[4]) : 4;
+	double base = 0;
+	for (int ahead = 0; ahead <= maxAhead; ahead++) {
+		runAheadTiming timing;
+		if (!measureRunAhead(args[2], args[3], (uint8_t)ahead, timing))
+			return -1;
+		if (ahead == 0) base = timing.microseconds;
+		printf("ahead %d: %.1f us/frame, %.1f us per frame ahead\n", ahead, timing.microseconds,
+			ahead ? (timing.microseconds - base) / ahead : 0.0);
+	}
+	return 0;
+}
+
+void printStop(debugger& dbg) {
+	static const char* reasons[] = { "", "step", "breakpoint", "read watch", "write watch", "cycle limit" };
+	cpuState regs = debugRegisters(dbg);
+	char text[32];
+	disassemble(dbg, regs.PC, text, sizeof(text));
+	if (dbg.stopReason == STOP_WATCH_READ || dbg.stopReason == STOP_WATCH_WRITE)
+		printf("%s $%04X = $%02X\n", reasons[dbg.stopReason], dbg.stopAddress, dbg.stopValue);
+	else if (dbg.stopReason != STOP_STEP)
+		printf("%s\n", reasons[dbg.stopReason]);
+	printf("%04X  %-16s A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%llu\n", regs.PC, text, regs.A, regs.X, regs.Y,
+		regs.FLAGS, regs.SP, (unsigned long long)dbg.machine->mycpu.cycles);
+}
+
+int runDebug(int iargs, char** args) {
+	if (iargs < 3) {
+		printf("usage: %s --debug rom.nes\n", args[0]);
+		return -1;
+	}
+	nes* _nes = (nes*)malloc(sizeof(nes));
+	debugger* dbg = (debugger*)malloc(sizeof(debugger));
+	if (!_nes || !dbg || !createNES(*_nes, args[2])) {
+		free(_nes);
+		free(dbg);
+		return -1;
+	}
+	createDebugger(*dbg, *_nes);
+	printf("s [n] step, c [cycles] continue, r regs, m addr [len] memory, d [addr] [n] disassemble\n");
+	printf("b addr toggle breakpoint, w addr r|w|rw toggle watchpoint, q quit\n");
+	char line[128];
+	while (printf("> "), fflush(stdout), fgets(line, sizeof(line), stdin)) {
+		char cmd = 0;
+		char kinds[4] = "rw";
+		unsigned int a = 0, b = 0;
+		int n = sscanf(line, " %c %x %x", &cmd, &a, &b);
+		if (n < 1)
+			continue;
+		if (cmd == 'q')
+			break;
+		switch (cmd) {
+		case 's':
+			for (unsigned int i = 0; i < (n > 1 ? a : 1); i++) {
+				if (debugStep(*dbg) != STOP_STEP)
+					break;
+			}
+			printStop(*dbg);
+			break;
+		case 'c':
+			debugContinue(*dbg, n > 1 ? a : 100000000);
+			printStop(*dbg);
+			break;
+		case 'r':
+			dbg->stopReason = STOP_STEP;
+			printStop(*dbg);
+			break;
+		case 'm':
+			for (unsigned int i = 0; i < (n > 2 ? b : 16); i++) {
+				uint8_t v;
+				if (i % 16 == 0) printf("%s%04X:", i ? "\n" : "", (a + i) & 0xFFFF);
+				if (debugPeek(*dbg, (uint16_t)(a + i), v)) printf(" %02X", v);
+				else printf(" --");
+			}
+			printf("\n");
+			break;
+		case 'd': {
+			uint16_t address = n > 1 ? (uint16_t)a : _nes->mycpu.PC;
+			for (unsigned int i = 0; i < (n > 2 ? b : 10); i++) {
+				char text[32];
+				uint8_t length = disassemble(*dbg, address, text, sizeof(text));
+				printf("%04X  %s\n", address, text);
+				address += length;
+			}
+			break;
+		}
+		case 'b':
+			setBreakpoint(*dbg, (uint16_t)a, !(dbg->flags[a & 0xFFFF] & DEBUG_BREAK_EXEC));
+			printf("breakpoint $%04X %s\n", a & 0xFFFF, (dbg->flags[a & 0xFFFF] & DEBUG_BREAK_EXEC) ? "on" : "off");
+			break;
+		case 'w': {
+			sscanf(line, " %*c %*x %3s", kinds);
+			uint8_t mask = (strchr(kinds, 'r') ? DEBUG_WATCH_READ : 0) | (strchr(kinds, 'w') ? DEBUG_WATCH_WRITE : 0);
+			setWatchpoint(*dbg, (uint16_t)a, mask, (dbg->flags[a & 0xFFFF] & mask) != mask);
+			printf("watch $%04X%s%s\n", a & 0xFFFF, (dbg->flags[a & 0xFFFF] & DEBUG_WATCH_READ) ? " read" : "",
+				(dbg->flags[a & 0xFFFF] & DEBUG_WATCH_WRITE) ? " write" : "");
+			break;
+		}
+		}
+	}
+	destroyDebugger(*dbg);
+	destroyNES(*_nes);
+	free(dbg);
+	free(_nes);
+	return 0;
+}
+
+void printConformance(const char* name, const conformanceResult& result) {
+	printf("%s: %s, %llu instructions, %llu cycles, stopped at $%04X\n", name, result.passed ? "pass" : "FAIL",
+		(unsigned long long)result.instructions, (unsigned long long)result.cycles, result.stopPC);
+	if (result.seconds > 0)
+		printf("  %.3f s, %.1f MHz emulated, %.1f M instructions/s\n", result.seconds,
+			result.cycles / result.seconds / 1e6, result.instructions / result.seconds / 1e6);
+}
+
+//runs whatever is in CONFORMANCE_DIR or the given directory, any of nestest.nes with nestest.log
+//or a converted nestest.ntr, and 6502_functional_test.bin (assembled with disable_decimal = 1,
+//the 2a03 has no decimal mode) with an optional 6502_functional_test.ntr
+int runConformance(int iargs, char** args) {
+	const char* dir = CONFORMANCE_DIR;
+	bool record = false;
+	uint16_t successPC = FUNCTIONAL_SUCCESS;
+	for (int i = 2; i < iargs; i++) {
+		if (strcmp(args[i], "--record") == 0) record = true;
+		else if (strncmp(args[i], "--success=", 10) == 0) successPC = (uint16_t)strtoul(args[i] + 10, nullptr, 16);
+		else dir = args[i];
+	}
+	char rom[1024], golden[1024], log[1024];
+	int ran = 0, failed = 0;
+	conformanceResult result;
+	snprintf(rom, sizeof(rom), "%s/nestest.nes", dir);
+	snprintf(golden, sizeof(golden), "%s/nestest.ntr", dir);
+	snprintf(log, sizeof(log), "%s/nestest.log", dir);
+	FILE* f = fopen(rom, "rb");
+	if (f) {
+		fclose(f);
+		bool haveTrace = (f = fopen(golden, "rb")) != nullptr;
+		if (f) fclose(f);
+		if (!haveTrace && (f = fopen(log, "r"))) {
+			fclose(f);
+			haveTrace = convertNestestLog(log, golden);
+		}
+		ran++;
+		if (runNestest(rom, haveTrace ? golden : nullptr, result)) {
+			printConformance("nestest", result);
+			if (result.result[0] || result.result[1])
+				printf("  error codes $02=%02X $03=%02X\n", result.result[0], result.result[1]);
+			failed += !result.passed;
+		}
+		else failed++;
+	}
+	snprintf(rom, sizeof(rom), "%s/6502_functional_test.bin", dir);
+	snprintf(golden, sizeof(golden), "%s/6502_functional_test.ntr", dir);
+	if ((f = fopen(rom, "rb"))) {
+		fclose(f);
+		bool haveTrace = record || ((f = fopen(golden, "rb")) && !fclose(f));
+		ran++;
+		//a traced run writes or compares every instruction, time a second untraced run for the speed figure
+		if (haveTrace && !runFunctionalTest(rom, successPC, golden, record, result))
+			failed++;
+		else if (haveTrace && !result.passed) {
+			printConformance("functional", result);
+			failed++;
+		}
+		else if (runFunctionalTest(rom, successPC, nullptr, false, result)) {
+			printConformance("functional", result);
+			failed += !result.passed;
+		}
+		else failed++;
+	}
+	if (!ran) {
+		printf("usage: %s --conformance [dir] [--record] [--success=3469]\n", args[0]);
+		printf("no nestest.nes or 6502_functional_test.bin in %s\n", dir);
+		return -1;
+	}
+	printf("%d of %d suites passed\n", ran - failed, ran);
+	return failed ? 1 : 0;
+}
+
+int runExport(int iargs, char** args) {
+	if (iargs < 5) {
+		printf("usage: %s --export rom.nes movie.nmv name [--keep]\n", args[0]);
+		return -1;
+	}
+	bool keep = iargs > 5 && strcmp(args[5], "--keep") == 0;
+	return exportMovie(args[2], args[3], args[4], keep) ? 0 : -1;
+}
+
+//writes the sidecar createNES picks up from next to the rom unless another path is given
+int runAnalyze(int iargs, char** args) {
+	if (iargs < 3) {
+		printf("usage: %s --analyze rom.nes [out" ANALYSIS_EXT "]\n", args[0]);
+		return -1;
+	}
+	char path[1024];
+	snprintf(path, sizeof(path), "%s" ANALYSIS_EXT, args[2]);
+	cartridge cart;
+	romAnalysis result;
+	if (!loadINES(cart, args[2]))
+		return -1;
+	if (!analyzeROM(cart, result)) {
+		destroyCartridge(cart);
+		return -1;
+	}
+	uint32_t code = 0, data = 0, tableEntries = 0;
+	for (uint32_t i = 0; i < result.prgSize; i++) {
+		if (result.flags[i] & (CODE_OPCODE | CODE_OPERAND)) code++;
+		else if (!(result.flags[i] & CODE_JUMPTABLE)) data++;
+	}
+	for (uint32_t i = 0; i < result.tableCount; i++) {
+		tableEntries += result.tables[i].entries;
+	}
+	printf("code %u bytes, data %u bytes, %u blocks, %u jump tables with %u entries\n", code, data,
+		result.blockCount, result.tableCount, tableEntries);
+	bool ok = saveAnalysis(result, iargs > 3 ? args[3] : path);
+	destroyAnalysis(result);
+	destroyCartridge(cart);
+	return ok ? 0 : -1;
+}
+
+int runBatchManifest(int iargs, char** args) {
+	if (iargs < 3) {
+		printf("usage: %s --batch manifest.txt [workers] [results.bin] [--deadline=seconds per job]\n", args[0]);
+		return -1;
+	}
+	static const char* statuses[] = { "completed", "cycle limit", "failed", "crashed", "not run", "timed out" };
+	double deadline = BATCH_DEADLINE;
+	const char* positional[2] = { nullptr, nullptr };
+	int positionals = 0;
+	for (int i = 3; i < iargs; i++) {
+		if (strncmp(args[i], "--deadline=", 11) == 0) deadline = atof(args[i] + 11);
+		else if (positionals < 2) positional[positionals++] = args[i];
+	}
+	const char* resultsPath = positional[1];
+	uint32_t workers = positional[0] ? (uint32_t)atoi(positional[0]) : 0;
+#ifndef _WIN32
+	if (!workers)
+		workers = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	batchJob* jobs;
+	uint32_t count;
+	if (!loadManifest(args[2], jobs, count))
+		return -1;
+	batchResult* results = (batchResult*)calloc(count ? count : 1, sizeof(batchResult));
+	batchSummary summary;
+	if (!results || !runBatch(jobs, count, workers, deadline, results, summary)) {
+		printf("could not start the workers\n");
+		free(results);
+		destroyManifest(jobs, count);
+		return -1;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		if (results[i].status == BATCH_COMPLETED || results[i].status == BATCH_LIMIT)
+			continue;
+		printf("job %u %s %s: %s", i, jobs[i].rom, jobs[i].movie, statuses[results[i].status]);
+		if (results[i].signal)
+			printf(" by signal %u", results[i].signal);
+		printf("\n");
+	}
+	bool ok = true;
+	if (resultsPath) {
+		FILE* f = fopen(resultsPath, "wb");
+		for (uint32_t i = 0; f && i < count; i++) {
+			uint8_t record[BATCH_RECORD];
+			packBatchResult(results[i], record);
+			fwrite(record, 1, sizeof(record), f);
+		}
+		ok = f && !ferror(f);
+		if (f) fclose(f);
+		if (!ok) printf("could not write %s\n", resultsPath);
+	}
+	printf("%u jobs: %u completed, %u cycle limit, %u failed, %u crashed, %u timed out, %u not run, %u worker restarts\n",
+		summary.jobs, summary.counts[BATCH_COMPLETED], summary.counts[BATCH_LIMIT], summary.counts[BATCH_FAILED],
+		summary.counts[BATCH_CRASHED], summary.counts[BATCH_TIMEOUT], summary.counts[BATCH_SKIPPED], summary.restarts);
+	if (summary.seconds > 0)
+		printf("%.3f s, %.1f jobs/s, %.1f MHz emulated in total\n", summary.seconds, summary.jobs / summary.seconds,
+			summary.cycles / summary.seconds / 1e6);
+	free(results);
+	destroyManifest(jobs, count);
+	return ok && !summary.counts[BATCH_FAILED] && !summary.counts[BATCH_CRASHED] && !summary.counts[BATCH_TIMEOUT]
+		&& !summary.counts[BATCH_SKIPPED] ? 0 : 1;
+}
 
 int main(int iargs, char** args){
+	if (iargs > 1 && strcmp(args[1], "--replay") == 0)
+		return runReplay(iargs, args);
+	if (iargs > 1 && strcmp(args[1], "--runahead") == 0)
+		return runAheadCost(iargs, args);
+	if (iargs > 1 && strcmp(args[1], "--debug") == 0)
+		return runDebug(iargs, args);
+	if (iargs > 1 && strcmp(args[1], "--conformance") == 0)
+		return runConformance(iargs, args);
+	if (iargs > 1 && strcmp(args[1], "--export") == 0)
+		return runExport(iargs, args);
+	if (iargs > 1 && strcmp(args[1], "--analyze") == 0)
+		return runAnalyze(iargs, args);
+	if (iargs > 1 && strcmp(args[1], "--batch") == 0)
+		return runBatchManifest(iargs, args);
 	mos6502 mycpu;
 	createCpu(mycpu);
 	device816 ram;
@@ -24,6 +367,19 @@ int main(int iargs, char** args){
 		printf("add rom error");
 		return -1;
 	}
+	apu myapu;
+	device816 apudev;
+	if (!createAPU(myapu, &mycpu.cycles)) {
+		printf("apu error");
+		return -1;
+	}
+	myapu.dmcread = &busRead816;
+	myapu.dmcdata = &mycpu;
+	createAPUDevice(apudev, myapu);
+	if (!addDevice(mycpu, apudev)) {
+		printf("add apu error");
+		return -1;
+	}
 	((uint8_t*)rom.data)[0] = 0x79;
 	((uint8_t*)rom.data)[1] = 0x00;
 	((uint8_t*)rom.data)[2] = 0x00;
@@ -32,11 +388,12 @@ int main(int iargs, char** args){
 	((uint8_t*)rom.data)[5] = 0x00;
 	((uint8_t*)rom.data)[6] = 0x69;
 	((uint8_t*)rom.data)[7] = 0x01;
-	((uint8_t*)ram.data)[0] = 0x81;
-	((uint8_t*)ram.data)[1] = 0x80;
+	ram.writefun(ram.data, 0, 0x81);
+	ram.writefun(ram.data, 1, 0x80);
 	stepCpu(mycpu);
 	stepCpu(mycpu);
 	//stepCpu(mycpu);
+	destroyAPU(myapu);
 	destroyRamDevice816(ram);
 	destroyRomDevice816(rom);
 	printf("successful run, A = 0x%02X\n", mycpu.A);
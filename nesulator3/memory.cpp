@@ -4,12 +4,93 @@
 #include <stdio.h>
 #include <cstring>
 
+/*
+###################################--- PAGED MEMORY ---#######################################
+*/
+
+bool createPagedMem(pagedMem& mem, uint32_t size, uint32_t salt) {
+	mem.salt = salt;
+	mem.hash = 0;
+	mem.pageCount = (uint16_t)((size + MEM_PAGE_SIZE - 1) / MEM_PAGE_SIZE);
+	mem.pages = (memPage**)calloc(mem.pageCount, sizeof(memPage*));
+	if (!mem.pages)
+		return false;
+	for (uint16_t i = 0; i < mem.pageCount; i++) {
+		mem.pages[i] = (memPage*)calloc(1, sizeof(memPage));
+		if (!mem.pages[i]) {
+			destroyPagedMem(mem);
+			return false;
+		}
+		mem.pages[i]->refs = 1;
+	}
+	return true;
+}
+
+//only the page table is copied, the pages themselves are shared until written
+bool forkPagedMem(pagedMem& child, const pagedMem& parent) {
+	child.pageCount = parent.pageCount;
+	child.salt = parent.salt;
+	child.hash = parent.hash;
+	child.pages = (memPage**)malloc(parent.pageCount * sizeof(memPage*));
+	if (!child.pages)
+		return false;
+	for (uint16_t i = 0; i < parent.pageCount; i++) {
+		child.pages[i] = parent.pages[i];
+		child.pages[i]->refs++;
+	}
+	return true;
+}
+
+void destroyPagedMem(pagedMem& mem) {
+	if (!mem.pages)
+		return;
+	for (uint16_t i = 0; i < mem.pageCount; i++) {
+		if (mem.pages[i] && --mem.pages[i]->refs == 0)
+			free(mem.pages[i]);
+	}
+	free(mem.pages);
+	mem.pages = nullptr;
+	mem.pageCount = 0;
+}
+
+uint8_t* writablePage(pagedMem& mem, uint16_t page) {
+	memPage* shared = mem.pages[page];
+	if (shared->refs == 1)
+		return shared->bytes;
+	memPage* copy = (memPage*)malloc(sizeof(memPage));
+	if (!copy) {
+		printf("out of memory copying page\n");
+		abort();
+	}
+	memcpy(copy->bytes, shared->bytes, MEM_PAGE_SIZE);
+	copy->refs = 1;
+	shared->refs--;
+	mem.pages[page] = copy;
+	return copy->bytes;
+}
+
+uint64_t computePagedHash(const pagedMem& mem) {
+	uint64_t hash = 0;
+	for (uint32_t address = 0; address < (uint32_t)mem.pageCount * MEM_PAGE_SIZE; address++) {
+		hash += hashByte(mem.salt, (uint16_t)address, pagedRead(mem, (uint16_t)address));
+	}
+	return hash;
+}
+
+/*
+###################################--- DEVICES ---#######################################
+*/
+
 uint8_t readMem816(void* mem, uint16_t add)
 {
-	printf("readmem at 0x%04X\n", add);
 	return ((uint8_t*)mem)[add];
 }
 
+uint8_t readRam816(void* mem, uint16_t add)
+{
+	return pagedRead(*(pagedMem*)mem, add);
+}
+
 void writeRom816(void* mem, uint16_t add, uint8_t val)
 {
 	//do nothing (READ ONLY)
@@ -17,7 +98,7 @@ void writeRom816(void* mem, uint16_t add, uint8_t val)
 
 void writeRam816(void* mem, uint16_t add, uint8_t val)
 {
-	((uint8_t*)mem)[add] = val;
+	pagedWrite(*(pagedMem*)mem, add, val);
 }
 
 bool createRomDevice816(device816& dev, uint16_t size, uint16_t offset) {
@@ -29,27 +110,65 @@ bool createRomDevice816(device816& dev, uint16_t size, uint16_t offset) {
 	return dev.data;
 }
 
+//rom backed by memory the device does not own, so it is never destroyed through the device
+void createSharedRomDevice816(device816& dev, const uint8_t* data, uint16_t size, uint16_t offset) {
+	dev.data = (void*)data;
+	dev.length = size;
+	dev.start = offset;
+	dev.readfun = &(readMem816);
+	dev.writefun = &(writeRom816);
+}
+
 void destroyRomDevice816(device816& dev) {
 	if(dev.data)
 		free(dev.data);
 }
 
 bool createRamDevice816(device816& dev, uint16_t size, uint16_t offset) {
-	dev.data = malloc(sizeof(uint8_t) * size);
+	pagedMem* mem = (pagedMem*)malloc(sizeof(pagedMem));
+	//the bus offset doubles as the hash salt, no two ram devices share one
+	if (mem && !createPagedMem(*mem, size, offset)) {
+		free(mem);
+		mem = nullptr;
+	}
+	dev.data = mem;
 	dev.length = size;
 	dev.start = offset;
-	dev.readfun = &(readMem816);
+	dev.readfun = &(readRam816);
 	dev.writefun = &(writeRam816);
 	return dev.data;
 }
 
+bool forkRamDevice816(device816& child, const device816& parent) {
+	pagedMem* mem = (pagedMem*)malloc(sizeof(pagedMem));
+	if (mem && !forkPagedMem(*mem, *(pagedMem*)parent.data)) {
+		free(mem);
+		mem = nullptr;
+	}
+	child = parent;
+	child.data = mem;
+	return child.data;
+}
+
 void destroyRamDevice816(device816& dev) {
-	if(dev.data)
+	if (dev.data) {
+		destroyPagedMem(*(pagedMem*)dev.data);
 		free(dev.data);
+	}
+	dev.data = nullptr;
 }
 
 void clearMem(device816& dev) {
-	memset(dev.data, 0, dev.length*sizeof(uint8_t));
+	if (dev.readfun == &(readRam816)) {
+		pagedMem& mem = *(pagedMem*)dev.data;
+		for (uint16_t i = 0; i < mem.pageCount; i++) {
+			memset(writablePage(mem, i), 0, MEM_PAGE_SIZE);
+		}
+		mem.hash = 0;
+	}
+	else {
+		memset(dev.data, 0, dev.length*sizeof(uint8_t));
+	}
 }
 
 bool load();
@@ -3,12 +3,63 @@
 
 #include "emulatorGlue.h"
 
+#define MEM_PAGE_SIZE 0x100
+
+//pages are reference counted so forked machines can share them until one side writes
+struct memPage {
+	uint32_t refs;
+	uint8_t bytes[MEM_PAGE_SIZE];
+};
+
+//hash is the sum of hashByte over every byte, so it is order independent and pagedWrite
+//keeps it up to date in O(1). writes made directly through writablePage are not tracked
+struct pagedMem {
+	memPage** pages;
+	uint16_t pageCount;
+	uint32_t salt;//keeps equal contents in different memories from hashing the same
+	uint64_t hash;
+};
+
+bool createPagedMem(pagedMem&, uint32_t size, uint32_t salt);
+bool forkPagedMem(pagedMem& child, const pagedMem& parent);
+void destroyPagedMem(pagedMem&);
+uint8_t* writablePage(pagedMem&, uint16_t page);
+uint64_t computePagedHash(const pagedMem&);
+
+//splitmix64 of the location and value, zero bytes contribute nothing so fresh memory hashes to 0
+inline
+uint64_t hashByte(uint32_t salt, uint16_t address, uint8_t val) {
+	if (!val)
+		return 0;
+	uint64_t x = ((uint64_t)salt << 32) | ((uint32_t)address << 8) | val;
+	x += 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+inline
+uint8_t pagedRead(const pagedMem& mem, uint16_t address) {
+	return mem.pages[address >> 8]->bytes[address & 0xFF];
+}
+
+inline
+void pagedWrite(pagedMem& mem, uint16_t address, uint8_t val) {
+	memPage* page = mem.pages[address >> 8];
+	uint8_t* bytes = page->refs > 1 ? writablePage(mem, address >> 8) : page->bytes;
+	uint8_t old = bytes[address & 0xFF];
+	mem.hash += hashByte(mem.salt, address, val) - hashByte(mem.salt, address, old);
+	bytes[address & 0xFF] = val;
+}
+
 bool createRamDevice816(device816&, uint16_t, uint16_t);
+bool forkRamDevice816(device816& child, const device816& parent);
 void destroyRamDevice816(device816&);
 
 bool createRomDevice816(device816&, uint16_t, uint16_t);
+void createSharedRomDevice816(device816&, const uint8_t*, uint16_t, uint16_t);
 void destroyRomDevice816(device816&);
 
 void clearMem(device816& dev);
 void load(device816& dev);
-#endif //memory
\ No newline at end of file
+#endif //memory
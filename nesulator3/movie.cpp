@@ -0,0 +1,113 @@
+#include "movie.h"
+
+#include <stdio.h>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const void* mapFile(const char* path, size_t& size, void*& mapping) {
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return nullptr;
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(file, &fileSize);
+	size = (size_t)fileSize.QuadPart;
+	HANDLE map = size ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+	CloseHandle(file);
+	if (!map)
+		return nullptr;
+	const void* view = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+	if (!view) {
+		CloseHandle(map);
+		return nullptr;
+	}
+	mapping = map;
+	return view;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return nullptr;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return nullptr;
+	}
+	size = (size_t)st.st_size;
+	void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED)
+		return nullptr;
+	mapping = nullptr;
+	return view;
+#endif
+}
+
+void unmapFile(const void* view, size_t size, void* mapping) {
+#ifdef _WIN32
+	(void)size;
+	UnmapViewOfFile(view);
+	CloseHandle((HANDLE)mapping);
+#else
+	(void)mapping;
+	munmap((void*)view, size);
+#endif
+}
+
+bool openMovie(movie& mov, const char* path) {
+	mov.data = (const uint8_t*)mapFile(path, mov.size, mov.mapping);
+	if (!mov.data) {
+		printf("could not map movie %s\n", path);
+		return false;
+	}
+	if (mov.size < MOVIE_HEADER || memcmp(mov.data, "NMV1", 4) != 0) {
+		printf("%s is not a movie file\n", path);
+		closeMovie(mov);
+		return false;
+	}
+	mov.frameCount = readLE32(mov.data + 4);
+	mov.ports = mov.data[8];
+	if ((mov.ports != 1 && mov.ports != 2) || (mov.size - MOVIE_HEADER) / mov.ports < mov.frameCount) {
+		printf("%s is truncated\n", path);
+		closeMovie(mov);
+		return false;
+	}
+	return true;
+}
+
+uint8_t movieInput(const movie& mov, uint32_t frame, int port) {
+	if (frame >= mov.frameCount || port >= mov.ports)
+		return 0;
+	return mov.data[MOVIE_HEADER + (size_t)frame * mov.ports + port];
+}
+
+bool saveMovie(const char* path, const uint8_t* inputs, uint32_t frameCount, uint8_t ports) {
+	FILE* f = fopen(path, "wb");
+	if (!f)
+		return false;
+	uint8_t header[MOVIE_HEADER] = { 'N', 'M', 'V', '1' };
+	header[4] = frameCount & 0xFF;
+	header[5] = (frameCount >> 8) & 0xFF;
+	header[6] = (frameCount >> 16) & 0xFF;
+	header[7] = frameCount >> 24;
+	header[8] = ports;
+	bool ok = fwrite(header, 1, MOVIE_HEADER, f) == MOVIE_HEADER
+		&& fwrite(inputs, 1, (size_t)frameCount * ports, f) == (size_t)frameCount * ports;
+	fclose(f);
+	return ok;
+}
+
+void closeMovie(movie& mov) {
+	if (mov.data)
+		unmapFile(mov.data, mov.size, mov.mapping);
+	mov.data = nullptr;
+	mov.size = 0;
+	mov.frameCount = 0;
+}
@@ -0,0 +1,39 @@
+#ifndef nesmovie
+#define nesmovie
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+input movie file layout, all values little endian
+0x00 "NMV1"
+0x04 uint32 frame count
+0x08 uint8 ports recorded (1 or 2)
+0x09 7 bytes reserved, zero
+0x10 frame count * ports bytes of button state (controller.h bit order), frame major
+*/
+#define MOVIE_HEADER 16
+
+struct movie {
+	const uint8_t* data;
+	size_t size;
+	uint32_t frameCount;
+	uint8_t ports;
+	void* mapping;//platform handle keeping the file mapped
+};
+
+//read only file mapping, shared with the other binary formats
+const void* mapFile(const char* path, size_t& size, void*& mapping);
+void unmapFile(const void* view, size_t size, void* mapping);
+
+inline
+uint32_t readLE32(const uint8_t* p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool openMovie(movie&, const char* path);
+uint8_t movieInput(const movie&, uint32_t frame, int port);
+bool saveMovie(const char* path, const uint8_t* inputs, uint32_t frameCount, uint8_t ports);
+void closeMovie(movie&);
+
+#endif
@@ -0,0 +1,365 @@
+#include "nes.h"
+#include "memory.h"
+#include "analysis.h"
+
+#include <stdio.h>
+#include <cstdlib>
+#include <cstring>
+
+#define RST_CYCLES 7
+#define NMI_CYCLES 7
+#define IRQ_CYCLES 7
+#define OAMDMA_CYCLES 513
+
+//the cpu cycle whose three dots reach the given ppu dot
+inline
+uint64_t dotCycle(uint64_t dot) {
+	return (dot + 2) / 3;
+}
+
+void oamDMAWrite(void* mynes, uint16_t /*address*/, uint8_t val) {
+	nes* _nes = (nes*)mynes;
+	_nes->myppu.OAMDMA = val;
+	//the copy starts once the writing instruction has finished
+	scheduleEvent(_nes->events, EVENT_DMA, _nes->mycpu.cycles);
+}
+
+uint8_t oamDMARead(void* /*mynes*/, uint16_t /*address*/) {
+	return 0;
+}
+
+bool addMirroredDevice(mos6502& _cpu, device816& dev, uint16_t stride, int count) {
+	device816 mirror = dev;
+	for (int i = 0; i < count; i++) {
+		mirror.start = dev.start + stride * i;
+		if (!addDevice(_cpu, mirror))
+			return false;
+	}
+	return true;
+}
+
+void releaseCartridge(cartridge* cart) {
+	if (cart && --cart->refs == 0) {
+		destroyCartridge(*cart);
+		free(cart);
+	}
+}
+
+//an analysis sidecar next to the rom decodes its known blocks up front, see --analyze
+void loadSidecar(nes& _nes, const char* romPath) {
+	char path[1024];
+	romAnalysis analysis;
+	if (snprintf(path, sizeof(path), "%s" ANALYSIS_EXT, romPath) < (int)sizeof(path)
+		&& loadAnalysis(*_nes.cart, path, analysis)) {
+		for (uint32_t i = 0; i < analysis.blockCount; i++) {
+			prefillBlock(_nes.mycpu, analysis.blocks[i].offset, analysis.blocks[i].bytes);
+		}
+		destroyAnalysis(analysis);
+	}
+}
+
+bool createNES(nes& _nes, const char* romPath) {
+	_nes.cart = (cartridge*)malloc(sizeof(cartridge));
+	if (!_nes.cart || !loadINES(*_nes.cart, romPath)) {
+		free(_nes.cart);
+		return false;
+	}
+	if (_nes.cart->prgSize > 0x8000) {
+		printf("prg rom too large for nrom\n");
+		destroyCartridge(*_nes.cart);
+		free(_nes.cart);
+		return false;
+	}
+	createCpu(_nes.mycpu);
+	createScheduler(_nes.events);
+	_nes.irqLine = false;
+	_nes.dmaHalted = false;
+	//from here destroyNES can release whatever has been created, so every failure hands the machine to it
+	_nes.myapu.blip = nullptr;
+	_nes.ram.data = nullptr;
+	_nes.prgram.data = nullptr;
+	if (!createPPU(_nes.myppu, &_nes.mycpu.cycles) || !attachCHR(_nes.myppu, _nes.cart->chrRam ? nullptr : _nes.cart->chr, _nes.cart->chrTiles, _nes.cart->mirroring)
+		|| !createAPU(_nes.myapu, &_nes.mycpu.cycles)) {
+		printf("ppu/apu error");
+		destroyNES(_nes);
+		return false;
+	}
+	_nes.myapu.dmcread = &busRead816;
+	_nes.myapu.dmcdata = &_nes.mycpu;
+	createControllers(_nes.pads);
+	if (!createRamDevice816(_nes.ram, 0x800, 0) || !createRamDevice816(_nes.prgram, 0x2000, 0x6000)) {
+		printf("ram error");
+		destroyNES(_nes);
+		return false;
+	}
+	createSharedRomDevice816(_nes.rom, _nes.cart->prg, (uint16_t)_nes.cart->prgSize, 0x8000);
+	createPPUDevice(_nes.ppudev, _nes.myppu);
+	createAPUDevice(_nes.apudev, _nes.myapu);
+	createControllerDevice(_nes.paddev, _nes.pads);
+	_nes.dmadev.data = &_nes;
+	_nes.dmadev.start = 0x4014;
+	_nes.dmadev.length = 1;
+	_nes.dmadev.readfun = &(oamDMARead);
+	_nes.dmadev.writefun = &(oamDMAWrite);
+	//reads go to the first matching device so the pads have to sit in front of the apu
+	bool ok = addMirroredDevice(_nes.mycpu, _nes.ram, 0x800, 4)
+		&& addDevice(_nes.mycpu, _nes.ppudev)
+		&& addDevice(_nes.mycpu, _nes.paddev)
+		&& addDevice(_nes.mycpu, _nes.dmadev)
+		&& addDevice(_nes.mycpu, _nes.apudev)
+		&& addDevice(_nes.mycpu, _nes.prgram)
+		&& addMirroredDevice(_nes.mycpu, _nes.rom, (uint16_t)_nes.cart->prgSize, 0x8000 / _nes.cart->prgSize);
+	if (!ok) {
+		printf("add device error");
+		destroyNES(_nes);
+		return false;
+	}
+	//nrom keeps prg fixed from $8000 up, so instructions there can be decoded once per rom byte
+	_nes.mycpu.decoded = _nes.cart->decoded;
+	_nes.mycpu.decodedMask = _nes.cart->prgSize - 1;
+	loadSidecar(_nes, romPath);
+	triggerRST(_nes.mycpu);
+	_nes.mycpu.cycles += RST_CYCLES;
+	_nes.myppu.events = &_nes.events;
+	_nes.myapu.events = &_nes.events;
+	scheduleEvent(_nes.events, EVENT_VBLANK, dotCycle(nextVblankDot(_nes.myppu)));
+	scheduleEvent(_nes.events, EVENT_APU_IRQ, nextAPUIRQ(_nes.myapu));
+	return true;
+}
+
+//maps a device data pointer of the parent onto the matching object in the child
+void* forkedDeviceData(nes& child, const nes& parent, void* data) {
+	if (data == parent.ram.data) return child.ram.data;
+	if (data == parent.prgram.data) return child.prgram.data;
+	if (data == &parent.myppu) return &child.myppu;
+	if (data == &parent.myapu) return &child.myapu;
+	if (data == &parent.pads) return &child.pads;
+	if (data == &parent.mycpu) return &child.mycpu;
+	if (data == &parent) return &child;
+	//anything else is immutable rom and is shared outright
+	return data;
+}
+
+//the child shares rom and chr rom outright and every ram page copy on write, so a fork
+//costs a handful of page tables rather than a copy of the machine
+bool forkNES(nes& child, const nes& parent) {
+	child.cart = parent.cart;
+	child.cart->refs++;
+	child.mycpu = parent.mycpu;
+	//traps belong to whoever set them up on the parent (the debugger), the child runs untrapped
+	child.mycpu.trapdata = nullptr;
+	for (int i = 0; i < 256; i++) {
+		untrapPage(child.mycpu, (uint8_t)i);
+	}
+	child.pads = parent.pads;
+	child.events = parent.events;
+	child.irqLine = parent.irqLine;
+	child.dmaHalted = parent.dmaHalted;
+	child.mycpu.devices = (device816*)malloc(parent.mycpu.deviceCount * sizeof(device816));
+	child.ram.data = nullptr;
+	child.prgram.data = nullptr;
+	bool ok = child.mycpu.devices && forkRamDevice816(child.ram, parent.ram) && forkRamDevice816(child.prgram, parent.prgram);
+	//forkPPU cleans up after itself, everything forked before it is unwound here
+	bool ppuForked = ok && forkPPU(child.myppu, parent.myppu, &child.mycpu.cycles);
+	ok = ppuForked && forkAPU(child.myapu, parent.myapu, &child.mycpu.cycles);
+	if (!ok) {
+		printf("fork error");
+		if (ppuForked)
+			destroyPPU(child.myppu);
+		destroyRamDevice816(child.ram);
+		destroyRamDevice816(child.prgram);
+		free(child.mycpu.devices);
+		child.mycpu.devices = nullptr;
+		releaseCartridge(child.cart);
+		child.cart = nullptr;
+		return false;
+	}
+	child.myapu.dmcdata = &child.mycpu;
+	child.myppu.events = &child.events;
+	child.myapu.events = &child.events;
+	child.rom = parent.rom;
+	child.ppudev = parent.ppudev;
+	child.apudev = parent.apudev;
+	child.paddev = parent.paddev;
+	child.dmadev = parent.dmadev;
+	child.ppudev.data = &child.myppu;
+	child.apudev.data = &child.myapu;
+	child.paddev.data = &child.pads;
+	child.dmadev.data = &child;
+	for (size_t i = 0; i < parent.mycpu.deviceCount; i++) {
+		child.mycpu.devices[i] = parent.mycpu.devices[i];
+		child.mycpu.devices[i].data = forkedDeviceData(child, parent, parent.mycpu.devices[i].data);
+	}
+	return true;
+}
+
+//an nmi during dma is taken when the cpu comes back
+void takeNMI(nes& _nes) {
+	if (_nes.myppu.nmiPending && !_nes.dmaHalted) {
+		_nes.myppu.nmiPending = false;
+		triggerNMI(_nes.mycpu);
+		_nes.mycpu.cycles += NMI_CYCLES;
+	}
+}
+
+void runEvents(nes& _nes) {
+	uint8_t kind;
+	while (popEvent(_nes.events, _nes.mycpu.cycles, kind)) {
+		switch (kind) {
+		case EVENT_VBLANK:
+			catchUpPPU(_nes.myppu);
+			scheduleEvent(_nes.events, EVENT_VBLANK, dotCycle(nextVblankDot(_nes.myppu)));
+			//reaching vblank is what raises nmi
+			takeNMI(_nes);
+			break;
+		case EVENT_NMI:
+			takeNMI(_nes);
+			break;
+		case EVENT_APU_IRQ:
+			//the line stays up until the game acknowledges it, so from here it is checked at instruction boundaries
+			if (apuIRQ(_nes.myapu))
+				_nes.irqLine = true;
+			else
+				scheduleEvent(_nes.events, EVENT_APU_IRQ, nextAPUIRQ(_nes.myapu));
+			break;
+		case EVENT_DMA: {
+			catchUpPPU(_nes.myppu);
+			uint16_t page = _nes.myppu.OAMDMA << 8;
+			for (int i = 0; i < 0x100; i++) {
+				pagedWrite(_nes.myppu.oamram, (uint8_t)(_nes.myppu.OAMADDR + i), busRead816(&_nes.mycpu, page | i));
+			}
+			//the cpu is halted for the copy, one cycle longer when it starts on an odd cycle
+			_nes.dmaHalted = true;
+			scheduleEvent(_nes.events, EVENT_DMA_DONE, _nes.mycpu.cycles + OAMDMA_CYCLES + (_nes.mycpu.cycles & 1));
+			break;
+		}
+		case EVENT_DMA_DONE:
+			_nes.dmaHalted = false;
+			if (_nes.myppu.nmiPending)
+				scheduleEvent(_nes.events, EVENT_NMI, _nes.mycpu.cycles);
+			break;
+		}
+	}
+}
+
+inline
+bool irqReady(const nes& _nes) {
+	return _nes.irqLine && !(_nes.mycpu.flags & 0x04) && !_nes.dmaHalted;
+}
+
+void serviceIRQ(nes& _nes) {
+	if (!apuIRQ(_nes.myapu)) {
+		_nes.irqLine = false;
+		scheduleEvent(_nes.events, EVENT_APU_IRQ, nextAPUIRQ(_nes.myapu));
+		return;
+	}
+	triggerIRQ(_nes.mycpu);
+	_nes.mycpu.cycles += IRQ_CYCLES;
+}
+
+//everything that happens between two instructions
+void instructionBoundary(nes& _nes) {
+	runEvents(_nes);
+	if (irqReady(_nes))
+		serviceIRQ(_nes);
+}
+
+//one instruction, or the rest of a dma halt
+int stepNES(nes& _nes) {
+	uint64_t start = _nes.mycpu.cycles;
+	if (_nes.dmaHalted)
+		_nes.mycpu.cycles = nextEventTime(_nes.events);
+	else
+		stepCpu(_nes.mycpu);
+	instructionBoundary(_nes);
+	return (int)(_nes.mycpu.cycles - start);
+}
+
+//the cpu runs freely up to the next scheduled event, the ppu and apu only catch up when touched
+void runNES(nes& _nes, uint64_t untilCycle) {
+	mos6502& _cpu = _nes.mycpu;
+	while (_cpu.cycles < untilCycle) {
+		if (_nes.dmaHalted) {
+			_cpu.cycles = nextEventTime(_nes.events);
+		}
+		else {
+			while (_cpu.cycles < untilCycle && _cpu.cycles < nextEventTime(_nes.events)) {
+				const decodedOp* op = decodedBlock(_cpu);
+				if (!op) {
+					stepCpu(_cpu);
+				}
+				else {
+					//a decoded block skips the lookups, every instruction is still followed by the same checks
+					const decodedOp* end = op + op->blockBytes;
+					runDecoded(_cpu, *op);
+					for (op += op->length; op < end && !irqReady(_nes) && _cpu.cycles < untilCycle
+						&& _cpu.cycles < nextEventTime(_nes.events); op += op->length) {
+						runDecoded(_cpu, *op);
+					}
+				}
+				if (irqReady(_nes))
+					break;
+			}
+		}
+		instructionBoundary(_nes);
+	}
+}
+
+bool runFrameUntil(nes& _nes, uint64_t untilCycle) {
+	catchUpPPU(_nes.myppu);
+	uint32_t frame = _nes.myppu.frameCounter;
+	while (_nes.myppu.frameCounter == frame) {
+		if (_nes.mycpu.cycles >= untilCycle)
+			return false;
+		uint64_t frameEnd = dotCycle(nextFrameDot(_nes.myppu));
+		runNES(_nes, frameEnd < untilCycle ? frameEnd : untilCycle);
+		catchUpPPU(_nes.myppu);
+	}
+	return true;
+}
+
+void runFrame(nes& _nes) {
+	runFrameUntil(_nes, UINT64_MAX);
+}
+
+#define SALT_CPU 0x20000
+
+uint64_t cpuRegisterHash(const mos6502& _cpu) {
+	return hashByte(SALT_CPU, 0, _cpu.A)
+		+ hashByte(SALT_CPU, 1, _cpu.X)
+		+ hashByte(SALT_CPU, 2, _cpu.Y)
+		+ hashByte(SALT_CPU, 3, _cpu.SP)
+		+ hashByte(SALT_CPU, 4, _cpu.PC & 0xFF)
+		+ hashByte(SALT_CPU, 5, _cpu.PC >> 8)
+		+ hashByte(SALT_CPU, 6, _cpu.flags);
+}
+
+//order independent sum of every memory and register, the cycle count is left out so the
+//same state reached at different times hashes the same (for loop detection)
+uint64_t stateHash(const nes& _nes) {
+	return ((pagedMem*)_nes.ram.data)->hash + ((pagedMem*)_nes.prgram.data)->hash
+		+ ppuStateHash(_nes.myppu) + cpuRegisterHash(_nes.mycpu);
+}
+
+bool verifyStateHash(const nes& _nes) {
+	uint64_t full = computePagedHash(*(pagedMem*)_nes.ram.data) + computePagedHash(*(pagedMem*)_nes.prgram.data)
+		+ computePPUStateHash(_nes.myppu) + cpuRegisterHash(_nes.mycpu);
+	uint64_t incremental = stateHash(_nes);
+	if (full != incremental) {
+		printf("state hash mismatch: incremental %016llx full %016llx\n", (unsigned long long)incremental, (unsigned long long)full);
+		return false;
+	}
+	return true;
+}
+
+void destroyNES(nes& _nes) {
+	destroyAPU(_nes.myapu);
+	destroyPPU(_nes.myppu);
+	destroyRamDevice816(_nes.ram);
+	destroyRamDevice816(_nes.prgram);
+	releaseCartridge(_nes.cart);
+	_nes.cart = nullptr;
+	free(_nes.mycpu.devices);
+	_nes.mycpu.devices = nullptr;
+	_nes.mycpu.deviceCount = 0;
+}
@@ -0,0 +1,41 @@
+#ifndef nesmachine
+#define nesmachine
+
+#include "cpu.h"
+#include "ppu.h"
+#include "apu.h"
+#include "controller.h"
+#include "cartridge.h"
+#include "scheduler.h"
+
+//a whole console, devices point back into this struct so it must not move once created
+struct nes {
+	mos6502 mycpu;
+	ppu myppu;
+	apu myapu;
+	controllers pads;
+	cartridge* cart;
+	device816 ram;
+	device816 prgram;
+	device816 rom;
+	device816 ppudev;
+	device816 apudev;
+	device816 paddev;
+	device816 dmadev;
+	scheduler events;
+	bool irqLine;//apu irq asserted, taken at the first instruction boundary with I clear
+	bool dmaHalted;//cpu stopped for oam dma until EVENT_DMA_DONE
+};
+
+bool createNES(nes&, const char* romPath);
+bool forkNES(nes& child, const nes& parent);
+int stepNES(nes&);
+void runNES(nes&, uint64_t untilCycle);
+void runFrame(nes&);
+//stops at the end of the frame or at the first instruction boundary from untilCycle on, false for the latter
+bool runFrameUntil(nes&, uint64_t untilCycle);
+uint64_t stateHash(const nes&);
+bool verifyStateHash(const nes&);
+void destroyNES(nes&);
+
+#endif
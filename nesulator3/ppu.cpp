@@ -1,6 +1,8 @@
 #include "ppu.h"
 
+#include <stdio.h>
 #include <cstdlib>
+#include <cstring>
 
 
 
@@ -8,67 +10,389 @@
 #define LINECOUNT 262
 #define PICTUREWIDTH 256
 #define PICTUREHEIGHT 240
-#define PRERENDEREND 21
-#define PICTUREEND 261
+#define VBLANKSTART 241
+#define PRERENDERLINE 261
 
+//outside the 16 bit cpu address range so ppu memories never collide with cpu ram salts
+#define SALT_OAM 0x10000
+#define SALT_VRAM 0x10001
+#define SALT_CHRRAM 0x10002
+#define SALT_PALETTE 0x10003
+#define SALT_REGISTERS 0x10004
 
-uint8_t read(void* myppu, uint16_t address) {
+/*
+###################################--- VRAM ACCESS ---#######################################
+*/
+
+inline
+uint16_t nametableIndex(ppu& _ppu, uint16_t address) {
+	if (_ppu.mirroring == MIRROR_VERTICAL)
+		return address & 0x7FF;
+	return ((address >> 1) & 0x400) | (address & 0x3FF);
+}
+
+inline
+uint8_t paletteIndex(uint16_t address) {
+	address &= 0x1F;
+	//sprite backdrop entries mirror the background ones
+	if ((address & 0x13) == 0x10) address &= 0x0F;
+	return (uint8_t)address;
+}
+
+//a chr ram cache still shared with a fork is copied before this machine's chr changes, like a memPage
+chrTileCache* writableTiles(ppu& _ppu) {
+	chrTileCache* shared = _ppu.tiles;
+	if (shared->refs == 1)
+		return shared;
+	chrTileCache* copy = (chrTileCache*)malloc(sizeof(chrTileCache));
+	if (!copy) {
+		printf("out of memory copying chr tiles\n");
+		abort();
+	}
+	memcpy(copy, shared, sizeof(chrTileCache));
+	copy->refs = 1;
+	shared->refs--;
+	_ppu.tiles = copy;
+	return copy;
+}
+
+void releaseTiles(ppu& _ppu) {
+	if (!_ppu.chrRom && _ppu.tiles && --_ppu.tiles->refs == 0)
+		free(_ppu.tiles);
+	_ppu.tiles = nullptr;
+}
+
+uint8_t readVram(ppu& _ppu, uint16_t address) {
+	address &= 0x3FFF;
+	if (address < 0x2000)
+		return _ppu.chrRom ? _ppu.chrRom[address] : pagedRead(_ppu.chrRam, address);
+	if (address < 0x3F00)
+		return pagedRead(_ppu.vram, nametableIndex(_ppu, address));
+	return _ppu.palette[paletteIndex(address)];
+}
+
+void writeVram(ppu& _ppu, uint16_t address, uint8_t val) {
+	address &= 0x3FFF;
+	if (address < 0x2000) {
+		if (!_ppu.chrRom) {
+			pagedWrite(_ppu.chrRam, address, val);
+			writableTiles(_ppu)->valid[address >> 4] = false;
+		}
+	}
+	else if (address < 0x3F00) {
+		pagedWrite(_ppu.vram, nametableIndex(_ppu, address), val);
+	}
+	else {
+		uint8_t index = paletteIndex(address);
+		_ppu.paletteHash += hashByte(SALT_PALETTE, index, val & 0x3F) - hashByte(SALT_PALETTE, index, _ppu.palette[index]);
+		_ppu.palette[index] = val & 0x3F;
+	}
+}
+
+inline
+void decodeTileRow(uint8_t lo, uint8_t hi, uint8_t* pixels) {
+	for (int bit = 0; bit < 8; bit++) {
+		pixels[bit] = ((lo >> (7 - bit)) & 1) | (((hi >> (7 - bit)) & 1) << 1);
+	}
+}
+
+void decodeTile(ppu& _ppu, uint16_t tile) {
+	uint8_t* pixels = _ppu.tiles->pixels[tile];
+	for (int row = 0; row < 8; row++) {
+		decodeTileRow(readVram(_ppu, tile * 16 + row), readVram(_ppu, tile * 16 + row + 8), pixels + row * 8);
+	}
+	_ppu.tiles->valid[tile] = true;
+}
+
+//8 pixels of one tile row, left to right
+inline
+const uint8_t* tileRow(ppu& _ppu, uint16_t tile, uint8_t row) {
+	if (!_ppu.tiles->valid[tile])
+		decodeTile(_ppu, tile);
+	return _ppu.tiles->pixels[tile] + row * 8;
+}
+
+/*
+###################################--- REGISTERS ---#######################################
+*/
+
+uint8_t ppuRead(void* myppu, uint16_t address) {
 	ppu* _ppu = (ppu*)myppu;
+	catchUpPPU(*_ppu);
 	address = address & 7;
 	if (address == 2) {
 		_ppu->scrollWriteNo = 0;
-		return _ppu->PPUSTATUS;
+		_ppu->openBus = (_ppu->PPUSTATUS & 0xE0) | (_ppu->openBus & 0x1F);
+		_ppu->PPUSTATUS &= 0x7F;
 	}
 	else if (address == 4) {
-		return _ppu->oamram[_ppu->PPUADDR];
+		_ppu->openBus = pagedRead(_ppu->oamram, _ppu->OAMADDR);
+	}
+	else if (address == 7) {
+		uint16_t vaddr = _ppu->PPUADDR & 0x3FFF;
+		if (vaddr < 0x3F00) {
+			_ppu->openBus = _ppu->PPUDATA;
+			_ppu->PPUDATA = readVram(*_ppu, vaddr);
+		}
+		else {
+			//palette reads are not buffered, the buffer gets the nametable underneath
+			_ppu->openBus = readVram(*_ppu, vaddr);
+			_ppu->PPUDATA = readVram(*_ppu, vaddr - 0x1000);
+		}
+		_ppu->PPUADDR += (_ppu->PPUCTRL & 0x04) ? 32 : 1;
 	}
+	return _ppu->openBus;
 }
-void write(void* myppu, uint16_t address, uint8_t val) {
+
+void ppuWrite(void* myppu, uint16_t address, uint8_t val) {
 	ppu* _ppu = (ppu*)myppu;
+	catchUpPPU(*_ppu);
 	address = address & 7;
+	_ppu->openBus = val;
 	switch (address){
 	case 0:
+		//enabling nmi part way through vblank fires one straight away
+		if (!(_ppu->PPUCTRL & 0x80) && (val & 0x80) && (_ppu->PPUSTATUS & 0x80)) {
+			_ppu->nmiPending = true;
+			if (_ppu->events) scheduleEvent(*_ppu->events, EVENT_NMI, *_ppu->clock);
+		}
 		_ppu->PPUCTRL = val;
+		_ppu->tempAddr = (_ppu->tempAddr & ~0x0C00) | ((val & 3) << 10);
 		break;
 	case 1:
 		_ppu->PPUMASK = val;
 		break;
 	case 3:
-		_ppu->PPUADDR == val;
+		_ppu->OAMADDR = val;
 		break;
 	case 4:
-		_ppu->oamram[_ppu->PPUADDR] = val;
+		pagedWrite(_ppu->oamram, _ppu->OAMADDR++, val);
 		break;
 	case 5:
 		_ppu->scrollWriteNo ^= 1;
 		//if operates based on the initial pre xor value of scrollWriteNo 0->X 1->Y
 		if (_ppu->scrollWriteNo) {
 			_ppu->PPUSCROLLX = val;
+			_ppu->tempAddr = (_ppu->tempAddr & ~0x001F) | (val >> 3);
+			_ppu->fineX = val & 7;
 		}
 		else {
 			_ppu->PPUSCROLLY = val;
+			_ppu->tempAddr = (_ppu->tempAddr & ~0x73E0) | ((val & 7) << 12) | ((val & 0xF8) << 2);
 		}
 		break;
 	case 6:
-		_ppu->PPUADDRWriteNo ^= 1;
-		if (_ppu->PPUADDRWriteNo) {
-			_ppu->PPUADDR = (val << 8) | (_ppu->PPUADDR & 0xFF);
+		_ppu->scrollWriteNo ^= 1;
+		if (_ppu->scrollWriteNo) {
+			_ppu->tempAddr = ((val & 0x3F) << 8) | (_ppu->tempAddr & 0xFF);
 		}
 		else {
-			_ppu->PPUSCROLLY = (_ppu->PPUADDR & 0xFF00) | val;
+			_ppu->tempAddr = (_ppu->tempAddr & 0xFF00) | val;
+			_ppu->PPUADDR = _ppu->tempAddr;
 		}
 		break;
 	case 7:
-
+		writeVram(*_ppu, _ppu->PPUADDR, val);
+		_ppu->PPUADDR += (_ppu->PPUCTRL & 0x04) ? 32 : 1;
 		break;
 	}
 }
 
-void createPPU(ppu& _ppu) {
+/*
+###################################--- RENDERING ---#######################################
+*/
+
+inline
+bool renderingEnabled(ppu& _ppu) {
+	return _ppu.PPUMASK & 0x18;
+}
+
+void incrementY(ppu& _ppu) {
+	uint16_t v = _ppu.PPUADDR;
+	if ((v & 0x7000) != 0x7000) {
+		v += 0x1000;
+	}
+	else {
+		v &= ~0x7000;
+		uint16_t y = (v >> 5) & 31;
+		if (y == 29) {
+			y = 0;
+			v ^= 0x0800;
+		}
+		else if (y == 31) {
+			y = 0;
+		}
+		else {
+			y++;
+		}
+		v = (v & ~0x03E0) | (y << 5);
+	}
+	_ppu.PPUADDR = v;
+}
+
+void renderBackground(ppu& _ppu, uint8_t* pixels) {
+	uint16_t v = _ppu.PPUADDR;
+	uint16_t tableBase = (_ppu.PPUCTRL & 0x10) << 4;
+	uint8_t fineY = (v >> 12) & 7;
+	for (int tile = 0; tile < 33; tile++) {
+		uint8_t index = readVram(_ppu, 0x2000 | (v & 0x0FFF));
+		uint8_t attr = readVram(_ppu, 0x23C0 | (v & 0x0C00) | ((v >> 4) & 0x38) | ((v >> 2) & 0x07));
+		uint8_t pal = ((attr >> (((v >> 4) & 4) | (v & 2))) & 3) << 2;
+		const uint8_t* row = tileRow(_ppu, tableBase + index, fineY);
+		int left = tile * 8 - _ppu.fineX;
+		if (left >= 0 && left + 8 <= PICTUREWIDTH) {
+			for (int bit = 0; bit < 8; bit++) {
+				pixels[left + bit] = row[bit] ? pal | row[bit] : 0;
+			}
+		}
+		else {
+			//the partial tiles at either edge when fine x scroll is set
+			for (int bit = 0; bit < 8; bit++) {
+				int x = left + bit;
+				if (x >= 0 && x < PICTUREWIDTH)
+					pixels[x] = row[bit] ? pal | row[bit] : 0;
+			}
+		}
+		if ((v & 0x1F) == 31) {
+			v &= ~0x1F;
+			v ^= 0x0400;
+		}
+		else {
+			v++;
+		}
+	}
+}
+
+//decoded pixels for one row of a sprite, vertical flip and 8x16 tiles are resolved here, horizontal flip is left to the caller
+const uint8_t* spriteRow(ppu& _ppu, const uint8_t* sprite, int line, uint8_t height) {
+	uint8_t tile = sprite[1];
+	if (sprite[2] & 0x80) line = height - 1 - line;
+	uint16_t index;
+	if (height == 16) {
+		index = ((tile & 1) << 8) + (tile & 0xFE);
+		if (line >= 8) {
+			index++;
+			line -= 8;
+		}
+	}
+	else {
+		index = ((_ppu.PPUCTRL & 0x08) << 5) + tile;
+	}
+	return tileRow(_ppu, index, line);
+}
+
+//fills pixels with palette entries for the sprites on this row, returns the x of any sprite 0 opaque pixels in sprite0
+void renderSprites(ppu& _ppu, int row, uint8_t* pixels, bool* sprite0) {
+	uint8_t height = (_ppu.PPUCTRL & 0x20) ? 16 : 8;
+	const uint8_t* oam = _ppu.oamram.pages[0]->bytes;
+	int found = 0;
+	for (int i = 0; i < 64; i++) {
+		const uint8_t* sprite = oam + i * 4;
+		int line = row - sprite[0] - 1;
+		if (line < 0 || line >= height)
+			continue;
+		if (++found > 8) {
+			_ppu.PPUSTATUS |= 0x20;
+			break;
+		}
+		uint8_t attr = sprite[2];
+		const uint8_t* pattern = spriteRow(_ppu, sprite, line, height);
+		for (int bit = 0; bit < 8; bit++) {
+			int x = sprite[3] + bit;
+			if (x >= PICTUREWIDTH)
+				break;
+			uint8_t px = pattern[(attr & 0x40) ? 7 - bit : bit];
+			//lower oam entries win, so only fill pixels no earlier sprite has claimed
+			if (!px || (pixels[x] & 3))
+				continue;
+			pixels[x] = 0x10 | ((attr & 3) << 2) | px | ((attr & 0x20) ? 0x80 : 0);
+			if (i == 0) sprite0[x] = true;
+		}
+	}
+}
+
+//2 bit background pattern value at screen column x of the current row, without the palette
+uint8_t backgroundPixel(ppu& _ppu, int x) {
+	uint16_t v = _ppu.PPUADDR;
+	int offset = x + _ppu.fineX;
+	uint16_t coarseX = (v & 0x1F) + (offset >> 3);
+	if (coarseX >= 32) {
+		coarseX -= 32;
+		v ^= 0x0400;
+	}
+	v = (v & ~0x1F) | coarseX;
+	uint8_t index = readVram(_ppu, 0x2000 | (v & 0x0FFF));
+	return tileRow(_ppu, ((_ppu.PPUCTRL & 0x10) << 4) + index, (v >> 12) & 7)[offset & 7];
+}
+
+//the status side effects of renderScanline without drawing anything: sprite overflow from
+//the sprite count, and sprite 0 hit from sprite 0's opaque pixels tested against the background
+void skipScanline(ppu& _ppu, int row) {
+	if (!(_ppu.PPUMASK & 0x10))
+		return;
+	uint8_t height = (_ppu.PPUCTRL & 0x20) ? 16 : 8;
+	const uint8_t* oam = _ppu.oamram.pages[0]->bytes;
+	int found = 0;
+	for (int i = 0; i < 64 && found <= 8; i++) {
+		int line = row - oam[i * 4] - 1;
+		if (line >= 0 && line < height) found++;
+	}
+	if (found > 8)
+		_ppu.PPUSTATUS |= 0x20;
+	int line = row - oam[0] - 1;
+	if ((_ppu.PPUSTATUS & 0x40) || !(_ppu.PPUMASK & 0x08) || line < 0 || line >= height)
+		return;
+	const uint8_t* pattern = spriteRow(_ppu, oam, line, height);
+	for (int bit = 0; bit < 8; bit++) {
+		int x = oam[3] + bit;
+		if (x >= PICTUREWIDTH - 1)
+			break;
+		//left column clipping of either layer hides the hit
+		if (x < 8 && (_ppu.PPUMASK & 0x06) != 0x06)
+			continue;
+		if (!pattern[(oam[2] & 0x40) ? 7 - bit : bit])
+			continue;
+		if (backgroundPixel(_ppu, x)) {
+			_ppu.PPUSTATUS |= 0x40;
+			return;
+		}
+	}
+}
+
+void renderScanline(ppu& _ppu, int row) {
+	uint8_t* out = writablePage(_ppu.frame, row);
+	uint8_t bg[PICTUREWIDTH];
+	uint8_t spr[PICTUREWIDTH];
+	bool sprite0[PICTUREWIDTH];
+	memset(bg, 0, sizeof(bg));
+	memset(spr, 0, sizeof(spr));
+	memset(sprite0, 0, sizeof(sprite0));
+	if (_ppu.PPUMASK & 0x08) {
+		renderBackground(_ppu, bg);
+		if (!(_ppu.PPUMASK & 0x02)) memset(bg, 0, 8);
+	}
+	if (_ppu.PPUMASK & 0x10) {
+		renderSprites(_ppu, row, spr, sprite0);
+		if (!(_ppu.PPUMASK & 0x04)) memset(spr, 0, 8);
+	}
+	for (int x = 0; x < PICTUREWIDTH; x++) {
+		uint8_t b = bg[x] & 3;
+		uint8_t s = spr[x] & 3;
+		if (sprite0[x] && b && s && x != 255) _ppu.PPUSTATUS |= 0x40;
+		uint8_t entry = b ? bg[x] : 0;
+		if (s && (!b || !(spr[x] & 0x80))) entry = spr[x] & 0x1F;
+		out[x] = _ppu.palette[entry];
+	}
+}
+
+/*
+###################################--- PUBLIC FUNCTIONS ---#######################################
+*/
+
+bool createPPU(ppu& _ppu, const uint64_t* clock) {
 	_ppu.OAMADDR = 0;
 	_ppu.OAMDATA = 0;
 	_ppu.OAMDMA = 0;
-	_ppu.oamram = (uint8_t*)malloc(sizeof(uint8_t)*0x200);
 	_ppu.PPUADDR = 0;
 	_ppu.PPUCTRL = 0;
 	_ppu.PPUDATA = 0;
@@ -80,14 +404,227 @@ void createPPU(ppu& _ppu) {
 	_ppu.frameCol = 0;
 	_ppu.frameRow = 0;
 	_ppu.scrollWriteNo = 0;
-	_ppu.PPUADDRWriteNo = 0;
+	_ppu.tempAddr = 0;
+	_ppu.fineX = 0;
+	_ppu.openBus = 0;
+	_ppu.nmiPending = false;
+	_ppu.clock = clock;
+	_ppu.time = clock ? *clock * 3 : 0;
+	_ppu.events = nullptr;
+	_ppu.skipRender = false;
+	_ppu.chrRom = nullptr;
+	_ppu.chrRam.pages = nullptr;
+	_ppu.mirroring = MIRROR_HORIZONTAL;
+	memset(_ppu.palette, 0, sizeof(_ppu.palette));
+	_ppu.paletteHash = 0;
+	_ppu.tiles = nullptr;
+	_ppu.oamram.pages = nullptr;
+	_ppu.vram.pages = nullptr;
+	_ppu.frame.pages = nullptr;
+	//paged memory starts zeroed, the framebuffer is output rather than state so its hash is unused
+	return createPagedMem(_ppu.oamram, 0x100, SALT_OAM)
+		&& createPagedMem(_ppu.vram, 0x800, SALT_VRAM)
+		&& createPagedMem(_ppu.frame, PICTUREWIDTH*PICTUREHEIGHT, 0);
+}
+
+//register state is copied, memories share their pages with the parent until written. chr rom tiles
+//belong to the cartridge and are shared outright, a chr ram cache is shared until either side changes chr
+bool forkPPU(ppu& child, const ppu& parent, const uint64_t* clock) {
+	child = parent;
+	child.clock = clock;
+	child.oamram.pages = nullptr;
+	child.vram.pages = nullptr;
+	child.frame.pages = nullptr;
+	child.chrRam.pages = nullptr;
+	if (!parent.chrRom)
+		child.tiles->refs++;
+	bool ok = forkPagedMem(child.oamram, parent.oamram)
+		&& forkPagedMem(child.vram, parent.vram)
+		&& forkPagedMem(child.frame, parent.frame);
+	if (ok && parent.chrRam.pages)
+		ok = forkPagedMem(child.chrRam, parent.chrRam);
+	//whatever was forked before the failure gives its page references back
+	if (!ok)
+		destroyPPU(child);
+	return ok;
+}
+
+//every tile of a chr rom decoded up front, the cartridge owns it and every machine using the rom reads it
+chrTileCache* createROMTiles(const uint8_t* chrRom) {
+	chrTileCache* tiles = (chrTileCache*)malloc(sizeof(chrTileCache));
+	if (!tiles)
+		return nullptr;
+	for (uint16_t tile = 0; tile < CHR_TILES; tile++) {
+		for (int row = 0; row < 8; row++) {
+			decodeTileRow(chrRom[tile * 16 + row], chrRom[tile * 16 + row + 8], tiles->pixels[tile] + row * 8);
+		}
+		tiles->valid[tile] = true;
+	}
+	tiles->refs = 1;
+	return tiles;
+}
+
+bool attachCHR(ppu& _ppu, const uint8_t* chrRom, chrTileCache* romTiles, uint8_t mirroring) {
+	releaseTiles(_ppu);
+	_ppu.chrRom = chrRom;
+	_ppu.mirroring = mirroring;
+	if (chrRom) {
+		_ppu.tiles = romTiles;
+		return romTiles;
+	}
+	_ppu.tiles = (chrTileCache*)calloc(1, sizeof(chrTileCache));
+	if (!_ppu.tiles)
+		return false;
+	_ppu.tiles->refs = 1;
+	if (!_ppu.chrRam.pages)
+		return createPagedMem(_ppu.chrRam, 0x2000, SALT_CHRRAM);
+	return true;
+}
+
+//for anything that changes what the pattern tables read back other than PPUDATA, such as mapper chr bank switches
+void invalidateCHR(ppu& _ppu, uint16_t address, uint16_t length) {
+	//chr rom tiles are shared and can not go stale
+	if (_ppu.chrRom)
+		return;
+	chrTileCache* tiles = writableTiles(_ppu);
+	for (uint32_t tile = address >> 4; tile < CHR_TILES && tile * 16 < (uint32_t)address + length; tile++) {
+		tiles->valid[tile] = false;
+	}
 }
 
 void stepPPU(ppu& _ppu) {
-	_ppu.frameRow += (_ppu.frameCol++) / LINEWIDTH;
-	_ppu.frameCounter += (_ppu.frameRow) / LINECOUNT;
-	_ppu.frameCol %= LINEWIDTH;
-	_ppu.frameRow %= LINECOUNT;
+	if (++_ppu.frameCol == LINEWIDTH) {
+		_ppu.frameCol = 0;
+		if (++_ppu.frameRow == LINECOUNT) {
+			_ppu.frameRow = 0;
+			_ppu.frameCounter++;
+		}
+	}
+	uint16_t row = _ppu.frameRow;
+	uint16_t col = _ppu.frameCol;
+	if (row < PICTUREHEIGHT) {
+		if (col == 256) {
+			if (renderingEnabled(_ppu)) {
+				if (_ppu.skipRender) skipScanline(_ppu, row);
+				else renderScanline(_ppu, row);
+				incrementY(_ppu);
+			}
+			else if (!_ppu.skipRender) {
+				memset(writablePage(_ppu.frame, row), _ppu.palette[0], PICTUREWIDTH);
+			}
+		}
+		else if (col == 257 && renderingEnabled(_ppu)) {
+			_ppu.PPUADDR = (_ppu.PPUADDR & ~0x041F) | (_ppu.tempAddr & 0x041F);
+		}
+	}
+	else if (row == VBLANKSTART && col == 1) {
+		_ppu.PPUSTATUS |= 0x80;
+		if (_ppu.PPUCTRL & 0x80) _ppu.nmiPending = true;
+	}
+	else if (row == PRERENDERLINE) {
+		if (col == 1) {
+			_ppu.PPUSTATUS &= 0x1F;
+		}
+		else if (!renderingEnabled(_ppu)) {
+			return;
+		}
+		else if (col == 256) {
+			incrementY(_ppu);
+		}
+		else if (col == 257) {
+			_ppu.PPUADDR = (_ppu.PPUADDR & ~0x041F) | (_ppu.tempAddr & 0x041F);
+		}
+		else if (col == 280) {
+			_ppu.PPUADDR = (_ppu.PPUADDR & ~0x7BE0) | (_ppu.tempAddr & 0x7BE0);
+		}
+		else if (col == 339 && (_ppu.frameCounter & 1)) {
+			//odd frames skip the last dot of the pre render line
+			_ppu.frameCol = LINEWIDTH - 1;
+		}
+	}
+}
 
+//runs dot by dot only where stepPPU acts, the idle dots between are skipped over in one go
+void runPPU(ppu& _ppu, uint64_t target) {
+	while (_ppu.time < target) {
+		uint16_t col = _ppu.frameCol;
+		uint16_t next = col < 1 ? 1 : col < 256 ? 256 : col < 257 ? 257 : col < 280 ? 280 : col < 339 ? 339 : LINEWIDTH;
+		uint64_t idle = next - col - 1;
+		if (idle > target - _ppu.time - 1) idle = target - _ppu.time - 1;
+		_ppu.frameCol += (uint16_t)idle;
+		_ppu.time += idle + 1;
+		stepPPU(_ppu);
+	}
+}
+
+void catchUpPPU(ppu& _ppu) {
+	if (_ppu.clock)
+		runPPU(_ppu, *_ppu.clock * 3);
 }
 
+//dot time the ppu next reaches row and col, assuming rendering stays as it is for the odd frame skip
+uint64_t nextDot(const ppu& _ppu, uint16_t row, uint16_t col) {
+	uint32_t now = _ppu.frameRow * LINEWIDTH + _ppu.frameCol;
+	uint32_t target = row * LINEWIDTH + col;
+	if (target > now)
+		return _ppu.time + target - now;
+	uint32_t dots = target + LINEWIDTH * LINECOUNT - now;
+	if (now < PRERENDERLINE * LINEWIDTH + 339 && (_ppu.frameCounter & 1) && (_ppu.PPUMASK & 0x18))
+		dots--;
+	return _ppu.time + dots;
+}
+
+uint64_t nextVblankDot(const ppu& _ppu) {
+	return nextDot(_ppu, VBLANKSTART, 1);
+}
+
+uint64_t nextFrameDot(const ppu& _ppu) {
+	return nextDot(_ppu, 0, 0);
+}
+
+void createPPUDevice(device816& dev, ppu& _ppu) {
+	dev.data = &_ppu;
+	dev.start = 0x2000;
+	dev.length = 0x2000;
+	dev.readfun = &(ppuRead);
+	dev.writefun = &(ppuWrite);
+}
+
+uint64_t ppuRegisterHash(const ppu& _ppu) {
+	return hashByte(SALT_REGISTERS, 0, _ppu.PPUCTRL)
+		+ hashByte(SALT_REGISTERS, 1, _ppu.PPUMASK)
+		+ hashByte(SALT_REGISTERS, 2, _ppu.PPUSTATUS)
+		+ hashByte(SALT_REGISTERS, 3, _ppu.OAMADDR)
+		+ hashByte(SALT_REGISTERS, 4, _ppu.PPUDATA)
+		+ hashByte(SALT_REGISTERS, 5, _ppu.PPUADDR & 0xFF)
+		+ hashByte(SALT_REGISTERS, 6, _ppu.PPUADDR >> 8)
+		+ hashByte(SALT_REGISTERS, 7, _ppu.tempAddr & 0xFF)
+		+ hashByte(SALT_REGISTERS, 8, _ppu.tempAddr >> 8)
+		+ hashByte(SALT_REGISTERS, 9, _ppu.fineX)
+		+ hashByte(SALT_REGISTERS, 10, _ppu.scrollWriteNo);
+}
+
+//O(1), the memory hashes are maintained as the write handlers run
+uint64_t ppuStateHash(const ppu& _ppu) {
+	return _ppu.oamram.hash + _ppu.vram.hash + (_ppu.chrRam.pages ? _ppu.chrRam.hash : 0)
+		+ _ppu.paletteHash + ppuRegisterHash(_ppu);
+}
+
+//the same hash recomputed from every byte, for checking the incremental one
+uint64_t computePPUStateHash(const ppu& _ppu) {
+	uint64_t hash = computePagedHash(_ppu.oamram) + computePagedHash(_ppu.vram) + ppuRegisterHash(_ppu);
+	if (_ppu.chrRam.pages)
+		hash += computePagedHash(_ppu.chrRam);
+	for (uint8_t i = 0; i < 32; i++) {
+		hash += hashByte(SALT_PALETTE, i, _ppu.palette[i]);
+	}
+	return hash;
+}
+
+void destroyPPU(ppu& _ppu) {
+	destroyPagedMem(_ppu.oamram);
+	destroyPagedMem(_ppu.vram);
+	destroyPagedMem(_ppu.frame);
+	destroyPagedMem(_ppu.chrRam);
+	releaseTiles(_ppu);
+}
@@ -2,6 +2,21 @@
 #define nesppu
 
 #include "emulatorGlue.h"
+#include "memory.h"
+#include "scheduler.h"
+
+#define MIRROR_HORIZONTAL 0
+#define MIRROR_VERTICAL 1
+#define CHR_TILES 512
+
+//both pattern tables decoded to one 2 bit pixel per byte. chr rom is decoded once per cartridge,
+//chr ram caches are shared with forks until one side changes chr and redecode tiles lazily after writes.
+//every machine sharing a cache has the same chr, so any of them may decode into it
+struct chrTileCache {
+	uint8_t pixels[CHR_TILES][64];
+	bool valid[CHR_TILES];
+	uint32_t refs;//machines sharing a chr ram cache, unused for chr rom
+};
 
 struct ppu {
 	uint8_t PPUCTRL;
@@ -11,20 +26,45 @@ struct ppu {
 	uint8_t OAMDATA;
 	uint8_t PPUSCROLLX;
 	uint8_t PPUSCROLLY;
-	uint16_t PPUADDR;
-	uint8_t PPUDATA;
+	uint16_t PPUADDR;//current vram address (v)
+	uint8_t PPUDATA;//read buffer
 	uint8_t OAMDMA;
-	uint8_t* oamram;
+	pagedMem oamram;
 	uint32_t frameCounter;
 	uint16_t frameRow;
 	uint16_t frameCol;
-	uint8_t scrollWriteNo;
-	uint8_t PPUADDRWriteNo;
+	uint8_t scrollWriteNo;//write latch shared by PPUSCROLL and PPUADDR
+	uint16_t tempAddr;//temporary vram address (t)
+	uint8_t fineX;
+	uint8_t openBus;
+	bool nmiPending;
+	uint64_t time;//dot the ppu has been run up to, three per cpu cycle
+	const uint64_t* clock;//cpu cycle counter the ppu catches up to
+	scheduler* events;//optional, told when a register write raises nmi
+	pagedMem vram;//2k of nametables
+	uint8_t palette[32];
+	uint64_t paletteHash;
+	const uint8_t* chrRom;//shared between forks, null when the cartridge has chr ram
+	pagedMem chrRam;
+	chrTileCache* tiles;//the cartridge's for chr rom, reference counted for chr ram
+	uint8_t mirroring;
+	pagedMem frame;//256x240 nes palette indices, one page per row
+	bool skipRender;//leave frame untouched and only produce the status flags games poll, may change between frames
 };
 
-void createPPU(ppu&);
+bool createPPU(ppu&, const uint64_t* clock);
+bool forkPPU(ppu& child, const ppu& parent, const uint64_t* clock);
+chrTileCache* createROMTiles(const uint8_t* chrRom);
+//romTiles is createROMTiles of chrRom and must outlive the ppu, both null for chr ram
+bool attachCHR(ppu&, const uint8_t* chrRom, chrTileCache* romTiles, uint8_t mirroring);
+void invalidateCHR(ppu&, uint16_t address, uint16_t length);
 void stepPPU(ppu&);
+void catchUpPPU(ppu&);
+uint64_t nextVblankDot(const ppu&);
+uint64_t nextFrameDot(const ppu&);
 void createPPUDevice(device816&, ppu&);
+uint64_t ppuStateHash(const ppu&);
+uint64_t computePPUStateHash(const ppu&);
 void destroyPPU(ppu&);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,89 @@
+#include "runahead.h"
+#include "movie.h"
+
+#include <chrono>
+#include <cstdlib>
+
+bool createRunAhead(runAhead& ra, nes& machine, uint8_t frames) {
+	ra.machine = &machine;
+	ra.frames = frames;
+	ra.forked = false;
+	ra.forkFailed = false;
+	ra.shown.pages = nullptr;
+	ra.ahead = (nes*)malloc(sizeof(nes));
+	return ra.ahead;
+}
+
+const pagedMem& runAheadFrame(runAhead& ra, uint8_t pad0, uint8_t pad1) {
+	nes& machine = *ra.machine;
+	if (ra.forked) {
+		//the presented picture outlives its fork in case the next fork fails
+		destroyPagedMem(ra.shown);
+		ra.shown = ra.ahead->myppu.frame;
+		ra.ahead->myppu.frame.pages = nullptr;
+		destroyNES(*ra.ahead);
+		ra.forked = false;
+	}
+	setButtons(machine.pads, 0, pad0);
+	setButtons(machine.pads, 1, pad1);
+	//the real frame keeps its audio, its picture is only needed when nothing runs ahead or the last fork failed
+	machine.myppu.skipRender = ra.frames > 0 && !ra.forkFailed;
+	runFrame(machine);
+	if (!ra.frames)
+		return machine.myppu.frame;
+	ra.forkFailed = !forkNES(*ra.ahead, machine);
+	if (ra.forkFailed)
+		return machine.myppu.skipRender && ra.shown.pages ? ra.shown : machine.myppu.frame;
+	ra.forked = true;
+	nes& ahead = *ra.ahead;
+	ahead.myapu.muted = true;
+	for (uint8_t i = 0; i < ra.frames; i++) {
+		ahead.myppu.skipRender = i + 1 < ra.frames;
+		runFrame(ahead);
+	}
+	return ahead.myppu.frame;
+}
+
+void destroyRunAhead(runAhead& ra) {
+	if (ra.forked)
+		destroyNES(*ra.ahead);
+	destroyPagedMem(ra.shown);
+	free(ra.ahead);
+	ra.ahead = nullptr;
+	ra.forked = false;
+}
+
+//plays the whole movie with the given run ahead, audio is drained each frame the way a frontend would
+bool measureRunAhead(const char* romPath, const char* moviePath, uint8_t frames, runAheadTiming& timing) {
+	movie mov;
+	if (!openMovie(mov, moviePath))
+		return false;
+	nes* _nes = (nes*)malloc(sizeof(nes));
+	runAhead ra;
+	if (!_nes || !createNES(*_nes, romPath)) {
+		free(_nes);
+		closeMovie(mov);
+		return false;
+	}
+	if (!createRunAhead(ra, *_nes, frames)) {
+		destroyNES(*_nes);
+		free(_nes);
+		closeMovie(mov);
+		return false;
+	}
+	int16_t samples[APU_BUFFER_SIZE];
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t frame = 0; frame < mov.frameCount; frame++) {
+		runAheadFrame(ra, movieInput(mov, frame, 0), movieInput(mov, frame, 1));
+		endAPUFrame(_nes->myapu, samples, APU_BUFFER_SIZE);
+	}
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	timing.frames = mov.frameCount;
+	timing.microseconds = mov.frameCount
+		? std::chrono::duration<double, std::micro>(elapsed).count() / mov.frameCount : 0;
+	destroyRunAhead(ra);
+	destroyNES(*_nes);
+	free(_nes);
+	closeMovie(mov);
+	return true;
+}
@@ -0,0 +1,32 @@
+#ifndef nesrunahead
+#define nesrunahead
+
+#include <stdint.h>
+#include <stddef.h>
+#include "nes.h"
+#include "memory.h"
+
+//the player sees a fork that has run frames ahead of the real console, hiding that many frames of
+//the game's own input lag. the fork is the save state: it shares every page with the console until
+//written, so saving is a page table copy and restoring is throwing the fork away
+struct runAhead {
+	nes* machine;//the real console, owns the audio and takes the input
+	nes* ahead;//scratch fork that is presented, rebuilt every frame
+	pagedMem shown;//picture of the last fork, presented again if the next fork fails
+	bool forked;
+	bool forkFailed;//the last fork failed, the real machine renders until one succeeds
+	uint8_t frames;
+};
+
+struct runAheadTiming {
+	uint32_t frames;
+	double microseconds;//host time per emulated frame including the frames run ahead
+};
+
+bool createRunAhead(runAhead&, nes& machine, uint8_t frames);
+//runs one host frame and returns the framebuffer to present, valid until the next call
+const pagedMem& runAheadFrame(runAhead&, uint8_t pad0, uint8_t pad1);
+void destroyRunAhead(runAhead&);
+bool measureRunAhead(const char* romPath, const char* moviePath, uint8_t frames, runAheadTiming&);
+
+#endif
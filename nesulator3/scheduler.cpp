@@ -0,0 +1,70 @@
+#include "scheduler.h"
+
+void swapEvents(scheduler& sched, uint8_t a, uint8_t b) {
+	schedEvent t = sched.heap[a];
+	sched.heap[a] = sched.heap[b];
+	sched.heap[b] = t;
+	sched.slot[sched.heap[a].kind] = a;
+	sched.slot[sched.heap[b].kind] = b;
+}
+
+//moves the entry at i up or down until the heap order holds again
+void siftEvent(scheduler& sched, uint8_t i) {
+	while (i > 0 && sched.heap[i].time < sched.heap[(i - 1) / 2].time) {
+		swapEvents(sched, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+	while (true) {
+		uint8_t smallest = i;
+		uint8_t left = i * 2 + 1;
+		uint8_t right = left + 1;
+		if (left < sched.count && sched.heap[left].time < sched.heap[smallest].time) smallest = left;
+		if (right < sched.count && sched.heap[right].time < sched.heap[smallest].time) smallest = right;
+		if (smallest == i)
+			return;
+		swapEvents(sched, i, smallest);
+		i = smallest;
+	}
+}
+
+void createScheduler(scheduler& sched) {
+	sched.count = 0;
+	for (int i = 0; i < EVENT_KINDS; i++) {
+		sched.slot[i] = EVENT_KINDS;
+	}
+}
+
+void scheduleEvent(scheduler& sched, uint8_t kind, uint64_t time) {
+	if (time == EVENT_NEVER) {
+		cancelEvent(sched, kind);
+		return;
+	}
+	uint8_t i = sched.slot[kind];
+	if (i == EVENT_KINDS) {
+		i = sched.count++;
+		sched.heap[i].kind = kind;
+		sched.slot[kind] = i;
+	}
+	sched.heap[i].time = time;
+	siftEvent(sched, i);
+}
+
+void cancelEvent(scheduler& sched, uint8_t kind) {
+	uint8_t i = sched.slot[kind];
+	if (i == EVENT_KINDS)
+		return;
+	sched.slot[kind] = EVENT_KINDS;
+	if (i != --sched.count) {
+		sched.heap[i] = sched.heap[sched.count];
+		sched.slot[sched.heap[i].kind] = i;
+		siftEvent(sched, i);
+	}
+}
+
+bool popEvent(scheduler& sched, uint64_t now, uint8_t& kind) {
+	if (!sched.count || sched.heap[0].time > now)
+		return false;
+	kind = sched.heap[0].kind;
+	cancelEvent(sched, kind);
+	return true;
+}
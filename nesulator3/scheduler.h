@@ -0,0 +1,40 @@
+#ifndef nesscheduler
+#define nesscheduler
+
+#include <stdint.h>
+
+//every kind of event the machine can wait on, each is pending at most once
+#define EVENT_VBLANK 0//ppu reaches the first dot of vblank
+#define EVENT_NMI 1//nmi raised outside the vblank edge, by enabling it part way through vblank
+#define EVENT_APU_IRQ 2//earliest cycle the apu frame or dmc irq can assert
+#define EVENT_MAPPER_IRQ 3//scanline counters, no supported mapper schedules it yet
+#define EVENT_DMA 4//oam dma requested, the cpu halts once the writing instruction finishes
+#define EVENT_DMA_DONE 5
+#define EVENT_KINDS 6
+#define EVENT_NEVER UINT64_MAX
+
+struct schedEvent {
+	uint64_t time;//cpu cycle the event is due on
+	uint8_t kind;
+};
+
+//binary min heap on time, slot tracks where each kind sits so rescheduling is a single sift
+struct scheduler {
+	schedEvent heap[EVENT_KINDS];
+	uint8_t slot[EVENT_KINDS];//EVENT_KINDS when the kind is not pending
+	uint8_t count;
+};
+
+void createScheduler(scheduler&);
+//replaces any pending event of the same kind, EVENT_NEVER cancels it
+void scheduleEvent(scheduler&, uint8_t kind, uint64_t time);
+void cancelEvent(scheduler&, uint8_t kind);
+//removes the earliest event if it is due by now
+bool popEvent(scheduler&, uint64_t now, uint8_t& kind);
+
+inline
+uint64_t nextEventTime(const scheduler& sched) {
+	return sched.count ? sched.heap[0].time : EVENT_NEVER;
+}
+
+#endif
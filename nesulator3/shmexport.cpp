@@ -0,0 +1,123 @@
+#include "shmexport.h"
+#include "nes.h"
+#include "movie.h"
+
+#include <stdio.h>
+#include <cstring>
+#include <cstdlib>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+//payload blocks start on their own cache lines, apart from the header readers poll
+#define SHM_ALIGN(x) (((x) + 63) & ~63U)
+
+#ifdef _WIN32
+//the export is posix shared memory, windows builds report it as unavailable
+bool createShmExport(shmExport& exp, const char* name) {
+	exp.header = nullptr;
+	printf("shared memory export is not supported on this platform\n");
+	return false;
+}
+
+void publishShmExport(shmExport&, const nes&, uint32_t) {}
+
+void destroyShmExport(shmExport&, bool) {}
+#else
+bool createShmExport(shmExport& exp, const char* name) {
+	exp.header = nullptr;
+	if (snprintf(exp.name, sizeof(exp.name), SHM_PREFIX "%s", name) >= (int)sizeof(exp.name)) {
+		printf("export name %s is too long\n", name);
+		return false;
+	}
+	uint32_t stateOffset = SHM_ALIGN(sizeof(shmHeader));
+	uint32_t frameOffset = SHM_ALIGN(stateOffset + sizeof(cpuState));
+	uint32_t ramOffset = SHM_ALIGN(frameOffset + SHM_FRAME_SIZE);
+	exp.size = SHM_ALIGN(ramOffset + SHM_RAM_SIZE);
+	//a region left behind by an earlier run is replaced rather than reused, readers still mapping it keep the old object
+	shm_unlink(exp.name);
+	int fd = shm_open(exp.name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) {
+		printf("could not create shared memory %s\n", exp.name);
+		return false;
+	}
+	void* view = ftruncate(fd, exp.size) == 0 ? mmap(nullptr, exp.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (view == MAP_FAILED) {
+		shm_unlink(exp.name);
+		return false;
+	}
+	//ftruncate hands back zeroed pages, so readers see sequence 0 and an empty snapshot until the first publish
+	exp.header = (shmHeader*)view;
+	exp.header->size = (uint32_t)exp.size;
+	exp.header->stateOffset = stateOffset;
+	exp.header->frameOffset = frameOffset;
+	exp.header->ramOffset = ramOffset;
+	exp.header->writerPid = (int32_t)getpid();
+	exp.header->version = SHM_VERSION;
+	std::atomic_thread_fence(std::memory_order_release);
+	exp.header->magic = SHM_MAGIC;
+	return true;
+}
+
+void publishShmExport(shmExport& exp, const nes& _nes, uint32_t frameNumber) {
+	shmHeader& header = *exp.header;
+	uint8_t* base = (uint8_t*)exp.header;
+	uint32_t sequence = header.sequence.load(std::memory_order_relaxed);
+	header.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	const mos6502& _cpu = _nes.mycpu;
+	cpuState state = { _cpu.A, _cpu.X, _cpu.Y, _cpu.SP, _cpu.PC, _cpu.flags };
+	memcpy(base + header.stateOffset, &state, sizeof(state));
+	//frame rows are pages, the copy into the region is the only one between the ppu and a reader
+	const pagedMem& frame = _nes.myppu.frame;
+	for (uint16_t row = 0; row < frame.pageCount; row++) {
+		memcpy(base + header.frameOffset + row * MEM_PAGE_SIZE, frame.pages[row]->bytes, MEM_PAGE_SIZE);
+	}
+	const pagedMem& ram = *(const pagedMem*)_nes.ram.data;
+	for (uint16_t page = 0; page < ram.pageCount; page++) {
+		memcpy(base + header.ramOffset + page * MEM_PAGE_SIZE, ram.pages[page]->bytes, MEM_PAGE_SIZE);
+	}
+	header.frameNumber = frameNumber;
+	header.cycles = _cpu.cycles;
+	header.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void destroyShmExport(shmExport& exp, bool unlink) {
+	if (!exp.header)
+		return;
+	exp.header->closed.store(1, std::memory_order_release);
+	munmap(exp.header, exp.size);
+	if (unlink)
+		shm_unlink(exp.name);
+	exp.header = nullptr;
+}
+#endif
+
+bool exportMovie(const char* romPath, const char* moviePath, const char* name, bool keep) {
+	movie mov;
+	if (!openMovie(mov, moviePath))
+		return false;
+	nes* _nes = (nes*)malloc(sizeof(nes));
+	shmExport exp;
+	if (!_nes || !createNES(*_nes, romPath)) {
+		free(_nes);
+		closeMovie(mov);
+		return false;
+	}
+	bool ok = createShmExport(exp, name);
+	for (uint32_t frame = 0; ok && frame < mov.frameCount; frame++) {
+		setButtons(_nes->pads, 0, movieInput(mov, frame, 0));
+		setButtons(_nes->pads, 1, movieInput(mov, frame, 1));
+		runFrame(*_nes);
+		publishShmExport(exp, *_nes, frame + 1);
+	}
+	destroyShmExport(exp, !keep);
+	destroyNES(*_nes);
+	free(_nes);
+	closeMovie(mov);
+	return ok;
+}
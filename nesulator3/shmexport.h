@@ -0,0 +1,60 @@
+#ifndef nesshmexport
+#define nesshmexport
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "cpu.h"
+
+/*
+shared memory export, one region per emulator instance named "/nesulator3-<name>"
+0x00 shmHeader
+stateOffset cpuState of the cpu at the end of the frame
+frameOffset 256x240 nes palette indices, row after row
+ramOffset   2k of internal ram
+
+the writer makes sequence odd, rewrites everything after the header and then makes sequence even
+again, one increment of 2 per published frame. a reader loads sequence (acquire), skips the
+snapshot while it is odd, reads what it needs straight out of the mapping, issues an acquire fence
+and loads sequence again. equal values mean the snapshot it read was whole, otherwise it retries.
+tools/shmreader.cpp is the reference reader, it sleeps briefly between polls while sequence is unchanged.
+closed is set (release) once the writer has published its last frame, a reader that sees it and then
+an unchanged sequence has read everything. writerPid lets a reader notice an emulator that died
+without closing, the region stays until the writer unlinks it
+*/
+#define SHM_MAGIC 0x4D48534EU//"NSHM"
+#define SHM_VERSION 2
+#define SHM_PREFIX "/nesulator3-"
+#define SHM_FRAME_SIZE (256 * 240)
+#define SHM_RAM_SIZE 0x800
+
+struct shmHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;//whole region, header included
+	uint32_t stateOffset;
+	uint32_t frameOffset;
+	uint32_t ramOffset;
+	int32_t writerPid;
+	std::atomic<uint32_t> closed;//nonzero once no further frames will be published
+	std::atomic<uint32_t> sequence;
+	uint32_t frameNumber;//written inside the sequence like the payload
+	uint64_t cycles;
+};
+
+struct shmExport {
+	shmHeader* header;
+	size_t size;
+	char name[64];
+};
+
+struct nes;
+
+bool createShmExport(shmExport&, const char* name);
+void publishShmExport(shmExport&, const nes&, uint32_t frameNumber);
+//unlink leaves the region in place for readers that attach after the run
+void destroyShmExport(shmExport&, bool unlink);
+//replays a movie publishing every frame as it completes
+bool exportMovie(const char* romPath, const char* moviePath, const char* name, bool keep);
+
+#endif
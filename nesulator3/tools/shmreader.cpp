@@ -0,0 +1,95 @@
+//reference reader for the shared memory export described in shmexport.h
+//prints one line per snapshot it manages to read whole, hashing the frame and ram the same way --replay does
+#include "../shmexport.h"
+
+#include <stdio.h>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+//sleep between polls while nothing new has been published, well under a frame
+#define POLL_SLEEP_NS 200000
+//polls between checks that the writer is still alive, catches a writer that died without closing
+#define LIVENESS_POLLS 500
+
+uint64_t hashBytes(const uint8_t* data, size_t length) {
+	uint64_t hash = FNV_OFFSET;
+	for (size_t i = 0; i < length; i++) {
+		hash ^= data[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+int main(int iargs, char** args) {
+	if (iargs < 2) {
+		printf("usage: %s name [snapshots]\n", args[0]);
+		return -1;
+	}
+	char name[64];
+	snprintf(name, sizeof(name), SHM_PREFIX "%s", args[1]);
+	long limit = iargs > 2 ? atol(args[2]) : 0;
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		printf("no export named %s\n", name);
+		return -1;
+	}
+	shmHeader* header = (shmHeader*)mmap(nullptr, sizeof(shmHeader), PROT_READ, MAP_SHARED, fd, 0);
+	if (header == MAP_FAILED || header->magic != SHM_MAGIC || header->version != SHM_VERSION) {
+		printf("%s is not a version %d export\n", name, SHM_VERSION);
+		close(fd);
+		return -1;
+	}
+	size_t size = header->size;
+	munmap(header, sizeof(shmHeader));
+	const uint8_t* base = (const uint8_t*)mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return -1;
+	header = (shmHeader*)base;
+	uint32_t seen = 0;
+	long snapshots = 0, torn = 0;
+	uint64_t polls = 0;
+	while (!limit || snapshots < limit) {
+		uint32_t before = header->sequence.load(std::memory_order_acquire);
+		if ((before & 1) || before == seen) {
+			//closed is stored after the last publish, an unchanged sequence behind it means nothing else is coming
+			if (header->closed.load(std::memory_order_acquire)) {
+				if (header->sequence.load(std::memory_order_relaxed) == before)
+					break;
+				continue;
+			}
+			if (++polls % LIVENESS_POLLS == 0 && kill(header->writerPid, 0) != 0)
+				break;
+			timespec pause = { 0, POLL_SLEEP_NS };
+			nanosleep(&pause, nullptr);
+			continue;
+		}
+		//everything is read in place, the second sequence load says whether it can be trusted
+		cpuState state;
+		memcpy(&state, base + header->stateOffset, sizeof(state));
+		uint32_t frame = header->frameNumber;
+		uint64_t cycles = header->cycles;
+		uint64_t frameHash = hashBytes(base + header->frameOffset, SHM_FRAME_SIZE);
+		uint64_t ramHash = hashBytes(base + header->ramOffset, SHM_RAM_SIZE);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (header->sequence.load(std::memory_order_relaxed) != before) {
+			torn++;
+			continue;
+		}
+		seen = before;
+		snapshots++;
+		printf("frame %u cycles %llu pc %04X a %02X x %02X y %02X p %02X sp %02X ram %016llx frame %016llx\n", frame,
+			(unsigned long long)cycles, state.PC, state.A, state.X, state.Y, state.FLAGS, state.SP,
+			(unsigned long long)ramHash, (unsigned long long)frameHash);
+	}
+	printf("%ld snapshots, %ld retried\n", snapshots, torn);
+	munmap((void*)base, size);
+	return 0;
+}